@@ -49,6 +49,10 @@ gst_egl_buffer_init (GstEGLBuffer * buffer, gpointer g_class)
 {
   buffer->texinfo = NULL;
   buffer->attach = NULL;
+  buffer->crop_left = 0;
+  buffer->crop_right = 0;
+  buffer->crop_top = 0;
+  buffer->crop_bottom = 0;
 }
 
 static void
@@ -92,7 +96,6 @@ GstEGLBuffer *
 gst_egl_buffer_new (GstGLDisplay * display, GstEGLBufferGenTexture gen, 
 		GstEGLBufferDelTexture del, gpointer data, GstVideoFormat format, gint gl_width, gint gl_height)
 {
-  GstEGLTexture *info;
   GstEGLBuffer *egl_buffer =
       (GstEGLBuffer *) gst_mini_object_new (GST_TYPE_EGL_BUFFER);
   egl_buffer->width = gl_width;
@@ -107,9 +110,17 @@ gst_egl_buffer_new (GstGLDisplay * display, GstEGLBufferGenTexture gen,
   if(gen)
     egl_buffer->texinfo = gen(data);
   else if(display)
-    gst_gl_display_gen_texture(display, egl_buffer);
+    gst_gl_display_gen_texture(display, egl_buffer, TRUE);
   
-  info = egl_buffer->texinfo;
+  gst_egl_buffer_map_texture(egl_buffer);
+  return egl_buffer;
+}
+
+/* Point the buffer data at the image of its texture, if it got one */
+void
+gst_egl_buffer_map_texture (GstEGLBuffer * egl_buffer)
+{
+  GstEGLTexture *info = egl_buffer->texinfo;
   if(info)
   {
     gint index;
@@ -118,7 +129,6 @@ gst_egl_buffer_new (GstGLDisplay * display, GstEGLBufferGenTexture gen,
 	GST_BUFFER_SIZE(egl_buffer) = gst_video_format_get_size (info->format, info->width, info->height);
 	GST_BUFFER(egl_buffer)->_gst_reserved[index] = info->hw_meta;
   }
-  return egl_buffer;
 }
 
 gboolean
@@ -48,6 +48,10 @@ struct _GstEGLBuffer {
   GstVideoFormat format;
   gint width;
   gint height;
+  gint crop_left;
+  gint crop_right;
+  gint crop_top;
+  gint crop_bottom;
   GstEGLTexture *texinfo;
   GstEGLBufferGenTexture gen;
   GstEGLBufferDelTexture del;
@@ -65,6 +69,7 @@ gboolean gst_egl_buffer_parse_caps (GstCaps* caps, gint* width, gint* height);
 
 /* used by gstgldisplay */
 void gst_egl_buffer_attach(GstEGLBuffer *buffer, GstBuffer *attach);
+void gst_egl_buffer_map_texture(GstEGLBuffer *buffer);
 
 G_END_DECLS
 
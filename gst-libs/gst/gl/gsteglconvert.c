@@ -0,0 +1,703 @@
+/*
+ * GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <unistd.h>
+
+#include "gsteglconvert.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_egl_convert_debug);
+#define GST_CAT_DEFAULT gst_egl_convert_debug
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2_KERNELS
+#endif
+
+#if (defined (__ARM_NEON__) || defined (__ARM_NEON)) && \
+    G_BYTE_ORDER == G_LITTLE_ENDIAN
+#include <arm_neon.h>
+#define HAVE_NEON_KERNELS
+#endif
+
+/* Software copy and conversion kernels used by the platform
+ * when a frame has to be written into an EGLImage */
+
+//////////////////////// scalar /////////////////////
+
+static void
+copy_rows_scalar (guint8 * dst, gint dst_stride, const guint8 * src,
+    gint src_stride, gint row_bytes, gint rows)
+{
+  gint i;
+
+  for (i = 0; i < rows; i++) {
+    memcpy (dst, src, row_bytes);
+    dst += dst_stride;
+    src += src_stride;
+  }
+}
+
+static void
+fill_alpha_rows_scalar (guint8 * dst, gint dst_stride, const guint8 * src,
+    gint src_stride, gint width, gint rows)
+{
+  gint i, j;
+
+  for (i = 0; i < rows; i++) {
+    guint8 *x = dst;
+    memcpy (dst, src, width * 4);
+    for (j = 0; j < width; j++) {
+      *(x + 3) = 0xFF;
+      x += 4;
+    }
+    dst += dst_stride;
+    src += src_stride;
+  }
+}
+
+static const GstEGLConvertKernels scalar_kernels = {
+  "scalar",
+  copy_rows_scalar,
+  fill_alpha_rows_scalar
+};
+
+//////////////////////// sse2 /////////////////////
+
+#ifdef HAVE_SSE2_KERNELS
+//copy and alpha fill in a single pass, 16 pixels per iteration
+static void
+fill_alpha_rows_sse2 (guint8 * dst, gint dst_stride, const guint8 * src,
+    gint src_stride, gint width, gint rows)
+{
+  const __m128i alpha = _mm_set1_epi32 ((gint) 0xFF000000);
+  gint i, j;
+
+  for (i = 0; i < rows; i++) {
+    const guint8 *s = src;
+    guint8 *d = dst;
+
+    for (j = 0; j + 16 <= width; j += 16, s += 64, d += 64) {
+      __m128i p0 = _mm_loadu_si128 ((const __m128i *) s);
+      __m128i p1 = _mm_loadu_si128 ((const __m128i *) (s + 16));
+      __m128i p2 = _mm_loadu_si128 ((const __m128i *) (s + 32));
+      __m128i p3 = _mm_loadu_si128 ((const __m128i *) (s + 48));
+      _mm_storeu_si128 ((__m128i *) d, _mm_or_si128 (p0, alpha));
+      _mm_storeu_si128 ((__m128i *) (d + 16), _mm_or_si128 (p1, alpha));
+      _mm_storeu_si128 ((__m128i *) (d + 32), _mm_or_si128 (p2, alpha));
+      _mm_storeu_si128 ((__m128i *) (d + 48), _mm_or_si128 (p3, alpha));
+    }
+    for (; j + 4 <= width; j += 4, s += 16, d += 16)
+      _mm_storeu_si128 ((__m128i *) d,
+          _mm_or_si128 (_mm_loadu_si128 ((const __m128i *) s), alpha));
+    for (; j < width; j++, s += 4, d += 4) {
+      d[0] = s[0];
+      d[1] = s[1];
+      d[2] = s[2];
+      d[3] = 0xFF;
+    }
+
+    dst += dst_stride;
+    src += src_stride;
+  }
+}
+
+//memcpy is already vectorized, only the alpha fill needs a kernel
+static const GstEGLConvertKernels sse2_kernels = {
+  "sse2",
+  copy_rows_scalar,
+  fill_alpha_rows_sse2
+};
+
+//non-temporal stores, the destination is never read and its lines are
+//written whole without going through the cache
+static void
+copy_rows_sse2_stream (guint8 * dst, gint dst_stride, const guint8 * src,
+    gint src_stride, gint row_bytes, gint rows)
+{
+  gint i;
+
+  for (i = 0; i < rows; i++) {
+    const guint8 *s = src;
+    guint8 *d = dst;
+    gint n = row_bytes;
+    gint head = MIN (n, (gint) ((16 - ((gsize) d & 15)) & 15));
+
+    memcpy (d, s, head);
+    s += head;
+    d += head;
+    n -= head;
+
+    for (; n >= 64; n -= 64, s += 64, d += 64) {
+      __m128i p0 = _mm_loadu_si128 ((const __m128i *) s);
+      __m128i p1 = _mm_loadu_si128 ((const __m128i *) (s + 16));
+      __m128i p2 = _mm_loadu_si128 ((const __m128i *) (s + 32));
+      __m128i p3 = _mm_loadu_si128 ((const __m128i *) (s + 48));
+      _mm_stream_si128 ((__m128i *) d, p0);
+      _mm_stream_si128 ((__m128i *) (d + 16), p1);
+      _mm_stream_si128 ((__m128i *) (d + 32), p2);
+      _mm_stream_si128 ((__m128i *) (d + 48), p3);
+    }
+    for (; n >= 16; n -= 16, s += 16, d += 16)
+      _mm_stream_si128 ((__m128i *) d, _mm_loadu_si128 ((const __m128i *) s));
+    memcpy (d, s, n);
+
+    dst += dst_stride;
+    src += src_stride;
+  }
+  //order the streamed lines before the upload is signalled done
+  _mm_sfence ();
+}
+
+static void
+fill_alpha_rows_sse2_stream (guint8 * dst, gint dst_stride, const guint8 * src,
+    gint src_stride, gint width, gint rows)
+{
+  const __m128i alpha = _mm_set1_epi32 ((gint) 0xFF000000);
+  gint i, j;
+
+  //pixels must not straddle a 16 byte boundary
+  if (((gsize) dst | dst_stride) & 3) {
+    fill_alpha_rows_sse2 (dst, dst_stride, src, src_stride, width, rows);
+    return;
+  }
+
+  for (i = 0; i < rows; i++) {
+    const guint8 *s = src;
+    guint8 *d = dst;
+    gint head = MIN (width, (gint) (((16 - ((gsize) d & 15)) & 15) / 4));
+
+    for (j = 0; j < head; j++, s += 4, d += 4) {
+      d[0] = s[0];
+      d[1] = s[1];
+      d[2] = s[2];
+      d[3] = 0xFF;
+    }
+    for (; j + 16 <= width; j += 16, s += 64, d += 64) {
+      __m128i p0 = _mm_loadu_si128 ((const __m128i *) s);
+      __m128i p1 = _mm_loadu_si128 ((const __m128i *) (s + 16));
+      __m128i p2 = _mm_loadu_si128 ((const __m128i *) (s + 32));
+      __m128i p3 = _mm_loadu_si128 ((const __m128i *) (s + 48));
+      _mm_stream_si128 ((__m128i *) d, _mm_or_si128 (p0, alpha));
+      _mm_stream_si128 ((__m128i *) (d + 16), _mm_or_si128 (p1, alpha));
+      _mm_stream_si128 ((__m128i *) (d + 32), _mm_or_si128 (p2, alpha));
+      _mm_stream_si128 ((__m128i *) (d + 48), _mm_or_si128 (p3, alpha));
+    }
+    for (; j + 4 <= width; j += 4, s += 16, d += 16)
+      _mm_stream_si128 ((__m128i *) d,
+          _mm_or_si128 (_mm_loadu_si128 ((const __m128i *) s), alpha));
+    for (; j < width; j++, s += 4, d += 4) {
+      d[0] = s[0];
+      d[1] = s[1];
+      d[2] = s[2];
+      d[3] = 0xFF;
+    }
+
+    dst += dst_stride;
+    src += src_stride;
+  }
+  _mm_sfence ();
+}
+
+static const GstEGLConvertKernels sse2_stream_kernels = {
+  "sse2-stream",
+  copy_rows_sse2_stream,
+  fill_alpha_rows_sse2_stream
+};
+#endif
+
+//////////////////////// neon /////////////////////
+
+#ifdef HAVE_NEON_KERNELS
+//copy and alpha fill in a single pass, 16 pixels per iteration
+static void
+fill_alpha_rows_neon (guint8 * dst, gint dst_stride, const guint8 * src,
+    gint src_stride, gint width, gint rows)
+{
+  const uint8x16_t alpha = vreinterpretq_u8_u32 (vdupq_n_u32 (0xFF000000));
+  gint i, j;
+
+  for (i = 0; i < rows; i++) {
+    const guint8 *s = src;
+    guint8 *d = dst;
+
+    for (j = 0; j + 16 <= width; j += 16, s += 64, d += 64) {
+      uint8x16_t p0 = vld1q_u8 (s);
+      uint8x16_t p1 = vld1q_u8 (s + 16);
+      uint8x16_t p2 = vld1q_u8 (s + 32);
+      uint8x16_t p3 = vld1q_u8 (s + 48);
+      vst1q_u8 (d, vorrq_u8 (p0, alpha));
+      vst1q_u8 (d + 16, vorrq_u8 (p1, alpha));
+      vst1q_u8 (d + 32, vorrq_u8 (p2, alpha));
+      vst1q_u8 (d + 48, vorrq_u8 (p3, alpha));
+    }
+    for (; j + 4 <= width; j += 4, s += 16, d += 16)
+      vst1q_u8 (d, vorrq_u8 (vld1q_u8 (s), alpha));
+    for (; j < width; j++, s += 4, d += 4) {
+      d[0] = s[0];
+      d[1] = s[1];
+      d[2] = s[2];
+      d[3] = 0xFF;
+    }
+
+    dst += dst_stride;
+    src += src_stride;
+  }
+}
+
+static const GstEGLConvertKernels neon_kernels = {
+  "neon",
+  copy_rows_scalar,
+  fill_alpha_rows_neon
+};
+
+//armv7 has no non-temporal stores, the closest is to write whole 64 byte
+//lines with q register stores, so that the write buffer never merges a
+//partial line into uncached or write-combined memory
+#define NEON_LINE 64
+
+static void
+copy_rows_neon_stream (guint8 * dst, gint dst_stride, const guint8 * src,
+    gint src_stride, gint row_bytes, gint rows)
+{
+  gint i;
+
+  for (i = 0; i < rows; i++) {
+    const guint8 *s = src;
+    guint8 *d = dst;
+    gint n = row_bytes;
+    gint head = MIN (n,
+        (gint) ((NEON_LINE - ((gsize) d & (NEON_LINE - 1))) & (NEON_LINE - 1)));
+
+    memcpy (d, s, head);
+    s += head;
+    d += head;
+    n -= head;
+
+    for (; n >= 64; n -= 64, s += 64, d += 64) {
+      uint8x16_t p0 = vld1q_u8 (s);
+      uint8x16_t p1 = vld1q_u8 (s + 16);
+      uint8x16_t p2 = vld1q_u8 (s + 32);
+      uint8x16_t p3 = vld1q_u8 (s + 48);
+      vst1q_u8 (d, p0);
+      vst1q_u8 (d + 16, p1);
+      vst1q_u8 (d + 32, p2);
+      vst1q_u8 (d + 48, p3);
+    }
+    memcpy (d, s, n);
+
+    dst += dst_stride;
+    src += src_stride;
+  }
+}
+
+static void
+fill_alpha_rows_neon_stream (guint8 * dst, gint dst_stride, const guint8 * src,
+    gint src_stride, gint width, gint rows)
+{
+  gint i, j;
+
+  if (((gsize) dst | dst_stride) & 3) {
+    fill_alpha_rows_neon (dst, dst_stride, src, src_stride, width, rows);
+    return;
+  }
+
+  //line align every row, fill_alpha_rows_neon then stores whole lines
+  for (i = 0; i < rows; i++) {
+    gint head = MIN (width,
+        (gint) (((NEON_LINE - ((gsize) dst & (NEON_LINE - 1)))
+                & (NEON_LINE - 1)) / 4));
+
+    for (j = 0; j < head; j++) {
+      dst[j * 4] = src[j * 4];
+      dst[j * 4 + 1] = src[j * 4 + 1];
+      dst[j * 4 + 2] = src[j * 4 + 2];
+      dst[j * 4 + 3] = 0xFF;
+    }
+    fill_alpha_rows_neon (dst + head * 4, 0, src + head * 4, 0, width - head,
+        1);
+
+    dst += dst_stride;
+    src += src_stride;
+  }
+}
+
+static const GstEGLConvertKernels neon_stream_kernels = {
+  "neon-stream",
+  copy_rows_neon_stream,
+  fill_alpha_rows_neon_stream
+};
+#endif
+
+//////////////////////// detection /////////////////////
+
+#ifdef HAVE_SSE2_KERNELS
+static gboolean
+cpu_has_sse2 (void)
+{
+#if defined (__x86_64__) || defined (_M_X64)
+  return TRUE;
+#elif defined (__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+  return __builtin_cpu_supports ("sse2");
+#else
+  //built with -msse2
+  return TRUE;
+#endif
+}
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+static gboolean
+cpu_has_neon (void)
+{
+#if defined (__aarch64__)
+  return TRUE;
+#else
+  gchar *cpuinfo = NULL;
+  gboolean ret = FALSE;
+
+  //Features : swp half thumb fastmult vfp edsp neon vfpv3 ...
+  if (g_file_get_contents ("/proc/cpuinfo", &cpuinfo, NULL, NULL)) {
+    ret = strstr (cpuinfo, " neon") != NULL;
+    g_free (cpuinfo);
+  }
+  return ret;
+#endif
+}
+#endif
+
+static gpointer
+select_kernels (gpointer data)
+{
+  const GstEGLConvertKernels *kernels = &scalar_kernels;
+  const gchar *force = g_getenv ("GST_EGL_CONVERT_KERNELS");
+
+  GST_DEBUG_CATEGORY_INIT (gst_egl_convert_debug, "eglconvert", 0,
+      "egl color conversion");
+
+#ifdef HAVE_NEON_KERNELS
+  if (cpu_has_neon ())
+    kernels = &neon_kernels;
+#endif
+#ifdef HAVE_SSE2_KERNELS
+  if (cpu_has_sse2 ())
+    kernels = &sse2_kernels;
+#endif
+
+  if (force) {
+    if (!strcmp (force, "scalar"))
+      kernels = &scalar_kernels;
+#ifdef HAVE_SSE2_KERNELS
+    else if (!strcmp (force, "sse2"))
+      kernels = &sse2_kernels;
+    else if (!strcmp (force, "sse2-stream"))
+      kernels = &sse2_stream_kernels;
+#endif
+#ifdef HAVE_NEON_KERNELS
+    else if (!strcmp (force, "neon"))
+      kernels = &neon_kernels;
+    else if (!strcmp (force, "neon-stream"))
+      kernels = &neon_stream_kernels;
+#endif
+    else
+      GST_WARNING ("GST_EGL_CONVERT_KERNELS=%s not available, using %s",
+          force, kernels->name);
+  }
+
+  GST_INFO ("using %s color space conversion kernels", kernels->name);
+  return (gpointer) kernels;
+}
+
+const GstEGLConvertKernels *
+gst_egl_convert_get_kernels (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  g_once (&once, select_kernels, NULL);
+  return once.retval;
+}
+
+const GstEGLConvertKernels *
+gst_egl_convert_get_reference_kernels (void)
+{
+  return &scalar_kernels;
+}
+
+static gpointer
+select_streaming_kernels (gpointer data)
+{
+  const GstEGLConvertKernels *kernels = NULL;
+
+  //a forced set is used for every destination
+  if (g_getenv ("GST_EGL_CONVERT_KERNELS"))
+    return NULL;
+
+#ifdef HAVE_NEON_KERNELS
+  if (cpu_has_neon ())
+    kernels = &neon_stream_kernels;
+#endif
+#ifdef HAVE_SSE2_KERNELS
+  if (cpu_has_sse2 ())
+    kernels = &sse2_stream_kernels;
+#endif
+
+  return (gpointer) kernels;
+}
+
+const GstEGLConvertKernels *
+gst_egl_convert_get_streaming_kernels (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  g_once (&once, select_streaming_kernels, NULL);
+  return once.retval;
+}
+
+static gpointer
+list_kernels (gpointer data)
+{
+  static const GstEGLConvertKernels *available[6];
+  gint n = 0;
+
+  available[n++] = &scalar_kernels;
+#ifdef HAVE_SSE2_KERNELS
+  if (cpu_has_sse2 ()) {
+    available[n++] = &sse2_kernels;
+    available[n++] = &sse2_stream_kernels;
+  }
+#endif
+#ifdef HAVE_NEON_KERNELS
+  if (cpu_has_neon ()) {
+    available[n++] = &neon_kernels;
+    available[n++] = &neon_stream_kernels;
+  }
+#endif
+  available[n] = NULL;
+
+  return (gpointer) available;
+}
+
+const GstEGLConvertKernels * const *
+gst_egl_convert_get_available_kernels (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  g_once (&once, list_kernels, NULL);
+  return once.retval;
+}
+
+//////////////////////// worker pool /////////////////////
+
+//below that many rows a slice costs more to hand over than to copy
+#define MIN_SLICE_ROWS 16
+
+struct _GstEGLConvertPool {
+  GThreadPool *workers;
+  gint n_threads;
+
+  GMutex *lock;
+  GCond *cond;
+  gint pending;
+
+  //calling thread only
+  guint bulk_ops;
+  guint row_ops;
+};
+
+//padding a plain copy can carry along between its rows, a cropped
+//plane skips more than that
+#define BULK_MAX_PADDING 64
+
+/* Same stride on both sides and rows that fill it: the plane is one
+ * block. Plain copies can carry a little row padding along, other
+ * kernels must not touch it */
+static gboolean
+op_is_contiguous (const GstEGLConvertOp * op)
+{
+  if (op->src_stride != op->dst_stride)
+    return FALSE;
+  if (op->unit == 1)
+    return op->src_stride - op->row_bytes <= BULK_MAX_PADDING;
+  return op->row_bytes * op->unit == op->src_stride;
+}
+
+static void
+run_op (const GstEGLConvertOp * op)
+{
+  if (op->rows <= 0)
+    return;
+
+  if (op->rows > 1 && op_is_contiguous (op))
+    op->func (op->dst, 0, op->src, 0,
+        op->src_stride / op->unit * (op->rows - 1) + op->row_bytes, 1);
+  else
+    op->func (op->dst, op->dst_stride, op->src, op->src_stride, op->row_bytes,
+        op->rows);
+}
+
+static void
+count_ops (GstEGLConvertPool * pool, const GstEGLConvertOp * ops, gint n_ops)
+{
+  gint i;
+
+  for (i = 0; i < n_ops; i++) {
+    if (ops[i].rows > 1 && op_is_contiguous (&ops[i]))
+      pool->bulk_ops++;
+    else
+      pool->row_ops++;
+  }
+}
+
+static void
+worker_func (gpointer data, gpointer user_data)
+{
+  GstEGLConvertPool *pool = user_data;
+
+  run_op (data);
+
+  g_mutex_lock (pool->lock);
+  if (--pool->pending == 0)
+    g_cond_signal (pool->cond);
+  g_mutex_unlock (pool->lock);
+}
+
+GstEGLConvertPool *
+gst_egl_convert_pool_new (gint n_threads)
+{
+  GstEGLConvertPool *pool;
+
+  //selecting the kernels initializes the debug category
+  gst_egl_convert_get_kernels ();
+
+  if (n_threads <= 0)
+    n_threads = MAX (1, (gint) sysconf (_SC_NPROCESSORS_ONLN));
+
+  pool = g_new0 (GstEGLConvertPool, 1);
+  pool->n_threads = n_threads;
+  pool->lock = g_mutex_new ();
+  pool->cond = g_cond_new ();
+  pool->pending = 0;
+  pool->bulk_ops = 0;
+  pool->row_ops = 0;
+
+  //the calling thread takes a share of every run
+  if (n_threads > 1) {
+    GError *error = NULL;
+    pool->workers = g_thread_pool_new (worker_func, pool, n_threads - 1, TRUE,
+        &error);
+    if (!pool->workers) {
+      GST_WARNING ("cannot start %d conversion threads: %s", n_threads - 1,
+          error ? error->message : "unknown error");
+      g_clear_error (&error);
+      pool->n_threads = 1;
+    }
+  }
+
+  GST_INFO ("conversion pool with %d threads", pool->n_threads);
+  return pool;
+}
+
+void
+gst_egl_convert_pool_free (GstEGLConvertPool * pool)
+{
+  if (pool->workers)
+    g_thread_pool_free (pool->workers, FALSE, TRUE);
+  g_mutex_free (pool->lock);
+  g_cond_free (pool->cond);
+  g_free (pool);
+}
+
+gint
+gst_egl_convert_pool_get_threads (GstEGLConvertPool * pool)
+{
+  return pool ? pool->n_threads : 1;
+}
+
+void
+gst_egl_convert_pool_pop_stats (GstEGLConvertPool * pool, guint * bulk_ops,
+    guint * row_ops)
+{
+  *bulk_ops = pool->bulk_ops;
+  *row_ops = pool->row_ops;
+  pool->bulk_ops = 0;
+  pool->row_ops = 0;
+}
+
+/* Every op is cut in up to n_threads slices of consecutive rows, the
+ * workers get all slices but the last one of each op, which the
+ * calling thread runs while they work */
+void
+gst_egl_convert_run (GstEGLConvertPool * pool, const GstEGLConvertOp * ops,
+    gint n_ops)
+{
+  GstEGLConvertOp *slices, *own;
+  gint n_work = 0, n_own = 0;
+  gint i, j;
+
+  if (pool)
+    count_ops (pool, ops, n_ops);
+
+  if (!pool || pool->n_threads <= 1) {
+    for (i = 0; i < n_ops; i++)
+      run_op (&ops[i]);
+    return;
+  }
+
+  //worker slices fill the array from the start, our own from the end
+  slices = g_new (GstEGLConvertOp, n_ops * pool->n_threads);
+  own = slices + n_ops * pool->n_threads;
+
+  for (i = 0; i < n_ops; i++) {
+    gint parts = CLAMP (ops[i].rows / MIN_SLICE_ROWS, 1, pool->n_threads);
+    gint first = 0;
+
+    for (j = 0; j < parts; j++) {
+      gint last = (gint64) ops[i].rows * (j + 1) / parts;
+      GstEGLConvertOp *slice =
+          (j == parts - 1) ? own - ++n_own : &slices[n_work++];
+
+      *slice = ops[i];
+      slice->dst += (gsize) first * ops[i].dst_stride;
+      slice->src += (gsize) first * ops[i].src_stride;
+      slice->rows = last - first;
+      first = last;
+    }
+  }
+
+  g_mutex_lock (pool->lock);
+  pool->pending = n_work;
+  for (i = 0; i < n_work; i++)
+    g_thread_pool_push (pool->workers, &slices[i], NULL);
+  g_mutex_unlock (pool->lock);
+
+  for (i = 1; i <= n_own; i++)
+    run_op (own - i);
+
+  g_mutex_lock (pool->lock);
+  while (pool->pending > 0)
+    g_cond_wait (pool->cond, pool->lock);
+  g_mutex_unlock (pool->lock);
+
+  g_free (slices);
+}
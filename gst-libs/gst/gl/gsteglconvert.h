@@ -0,0 +1,91 @@
+/*
+ * GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_EGL_CONVERT_H__
+#define __GST_EGL_CONVERT_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Copies rows of row_bytes bytes */
+typedef void (* GstEGLCopyRowsFunc) (guint8 * dst, gint dst_stride,
+    const guint8 * src, gint src_stride, gint row_bytes, gint rows);
+
+/* Copies rows of width 32 bit pixels, setting their 4th byte (alpha) to 0xff */
+typedef void (* GstEGLFillAlphaRowsFunc) (guint8 * dst, gint dst_stride,
+    const guint8 * src, gint src_stride, gint width, gint rows);
+
+typedef struct _GstEGLConvertKernels GstEGLConvertKernels;
+
+struct _GstEGLConvertKernels {
+  const gchar *name;
+  GstEGLCopyRowsFunc copy_rows;
+  GstEGLFillAlphaRowsFunc fill_alpha_rows;
+};
+
+typedef struct _GstEGLConvertOp GstEGLConvertOp;
+typedef struct _GstEGLConvertPool GstEGLConvertPool;
+
+/* One plane worth of rows for a kernel, row_bytes counts units of unit
+ * bytes: 1 for copy_rows, 4 (pixels) for fill_alpha_rows */
+struct _GstEGLConvertOp {
+  GstEGLCopyRowsFunc func;
+  guint8 *dst;
+  gint dst_stride;
+  const guint8 *src;
+  gint src_stride;
+  gint row_bytes;
+  gint rows;
+  gint unit;
+};
+
+/* The kernels for this cpu, GST_EGL_CONVERT_KERNELS=scalar|sse2|neon
+ * (or sse2-stream|neon-stream) overrides the detection */
+const GstEGLConvertKernels * gst_egl_convert_get_kernels (void);
+
+/* Kernels writing whole cache lines with streaming stores, for uncached or
+ * write-combined destinations. NULL if this cpu has none or the kernels
+ * are forced */
+const GstEGLConvertKernels * gst_egl_convert_get_streaming_kernels (void);
+
+/* The plain C kernels every other one must match */
+const GstEGLConvertKernels * gst_egl_convert_get_reference_kernels (void);
+
+/* Every set this cpu can run, whatever is selected or forced, the
+ * reference first and NULL terminated */
+const GstEGLConvertKernels * const * gst_egl_convert_get_available_kernels (void);
+
+/* Persistent workers running ops in row slices, n_threads counts the
+ * calling thread and 0 means one per online cpu */
+GstEGLConvertPool * gst_egl_convert_pool_new (gint n_threads);
+void gst_egl_convert_pool_free (GstEGLConvertPool * pool);
+gint gst_egl_convert_pool_get_threads (GstEGLConvertPool * pool);
+
+/* Number of ops run as one bulk copy and row by row since the last call */
+void gst_egl_convert_pool_pop_stats (GstEGLConvertPool * pool,
+    guint * bulk_ops, guint * row_ops);
+
+/* Runs the ops and returns once they are all done, pool can be NULL */
+void gst_egl_convert_run (GstEGLConvertPool * pool, const GstEGLConvertOp * ops,
+    gint n_ops);
+
+G_END_DECLS
+
+#endif /* __GST_EGL_CONVERT_H__ */
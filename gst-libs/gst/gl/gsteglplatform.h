@@ -2,6 +2,7 @@
 #define __GST_EGL_PLATFORM_H__
 
 #include "gstegltypes.h"
+#include "gsteglconvert.h"
 
 G_BEGIN_DECLS
 
@@ -16,6 +17,8 @@ void                  gst_egl_platform_get_format_info(GstVideoFormat videoforma
                                                        GLenum *format,
                                                        GLenum *type);
 
+gsize                 gst_egl_platform_get_image_size(GstVideoFormat format, gint width, gint height);
+
 void                  gst_egl_platform_alloc_image(EGLDisplay display, GstEGLTexture *info);
 void                  gst_egl_platform_free_image(EGLDisplay display, GstEGLTexture *info);
 
@@ -24,7 +27,9 @@ GLenum                gst_egl_platform_get_target(GstVideoFormat videoformat);
 gboolean              gst_egl_platform_accept_caps(GstVideoFormat format, gint width, gint height);
 
 gboolean              gst_egl_platform_convert_color_space(gpointer src, GstVideoFormat srcfmt, gpointer dst,
-		                      GstVideoFormat dstfmt, gint width, gint height, gint stride);
+		                      GstVideoFormat dstfmt, gint width, gint height, gint stride,
+		                      const GstEGLRect *rect, const GstEGLConvertKernels *kernels,
+		                      GstEGLConvertPool *pool);
 
 G_END_DECLS
 
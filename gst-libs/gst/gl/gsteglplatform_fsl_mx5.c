@@ -20,6 +20,7 @@
 #include "gsteglplatform.h"
 #include "gstgldisplay.h"
 #include "gsteglbuffer.h"
+#include "gsteglconvert.h"
 #include "gst/fsl/gstbufmeta.h"
 
 #define FSL_FRAGMENT_SOURCE(sampler) 				\
@@ -196,6 +197,51 @@ gst_egl_platform_get_format_info(GstVideoFormat videoformat, GLenum *internalfor
   }
 }
 
+#define PAGE_ALIGN(size) (((size) + 4095) & (~4095))
+
+/* Size of the contiguous memory behind an image, following the plane layout
+ * the driver uses (see copy_planar_yuv420) */
+static gsize
+get_image_size(GstVideoFormat real_format, gint width, gint height, gint stride)
+{
+  switch(real_format)
+  {
+    case GST_VIDEO_FORMAT_RGBA:
+    case GST_VIDEO_FORMAT_BGRA:
+    case GST_VIDEO_FORMAT_UYVY:
+      return (gsize)stride * height;
+    case GST_VIDEO_FORMAT_YV12:
+      return PAGE_ALIGN((gsize)stride * GST_ROUND_UP_32(height)) +
+          2 * PAGE_ALIGN((gsize)GST_ROUND_UP_32(stride/2) * GST_ROUND_UP_32(height/2));
+    case GST_VIDEO_FORMAT_NV12:
+      return PAGE_ALIGN((gsize)stride * GST_ROUND_UP_32(height)) +
+          PAGE_ALIGN((gsize)stride * GST_ROUND_UP_32(height/2));
+    default:
+      return gst_video_format_get_size(real_format, width, height);
+  }
+}
+
+gsize
+gst_egl_platform_get_image_size(GstVideoFormat format, gint width, gint height)
+{
+  gint stride;
+  get_fsl_format(&format);
+  switch(format)
+  {
+    case GST_VIDEO_FORMAT_RGBA:
+    case GST_VIDEO_FORMAT_BGRA:
+      stride = GST_ROUND_UP_32(width) * 4;
+      break;
+    case GST_VIDEO_FORMAT_UYVY:
+      stride = GST_ROUND_UP_32(width) * 2;
+      break;
+    default:
+      stride = GST_ROUND_UP_64(width);
+      break;
+  }
+  return get_image_size(format, width, height, stride);
+}
+
 void
 gst_egl_platform_alloc_image(EGLDisplay display, GstEGLTexture *info)
 {
@@ -226,6 +272,7 @@ gst_egl_platform_alloc_image(EGLDisplay display, GstEGLTexture *info)
       info->stride = GST_ROUND_UP_32(info->width) * 4;
     else
       info->stride = meta.stride;
+    info->size = get_image_size(real_format, info->width, info->height, info->stride);
   }
   else
     GST_ERROR("Cannot alloc image [%d, %d] with format %d", info->width, info->height, info->format);
@@ -308,11 +355,51 @@ gst_egl_platform_accept_caps(GstVideoFormat format, gint width, gint height)
 }
 
 static void
-copy_planar_yuv420(gpointer src, gpointer dst, gint width,
-        gint height, gint dst_stride)
+set_op(GstEGLConvertOp *op, GstEGLCopyRowsFunc func, gpointer dst,
+        gint dst_stride, gpointer src, gint src_stride, gint row_bytes, gint rows)
+{
+  op->unit = 1;
+  op->func = func;
+  op->dst = dst;
+  op->dst_stride = dst_stride;
+  op->src = src;
+  op->src_stride = src_stride;
+  op->row_bytes = row_bytes;
+  op->rows = rows;
+}
+
+/* Copy of the part of a plane under rect, sub is the plane subsampling
+ * and bpp its bytes per pixel */
+static void
+set_plane_op(GstEGLConvertOp *op, GstEGLCopyRowsFunc func, gpointer dst,
+        gint dst_stride, gpointer src, gint src_stride, const GstEGLRect *rect,
+        gint sub, gint bpp)
+{
+  gint x = rect->x / sub * bpp;
+  gint y = rect->y / sub;
+  set_op(op, func, (guint8*)dst + (gsize)y * dst_stride + x, dst_stride,
+      (guint8*)src + (gsize)y * src_stride + x, src_stride,
+      rect->width / sub * bpp, rect->height / sub);
+}
+
+//chroma is shared by 2x2 pixels, the rect is grown to even bounds
+static void
+align_rect_420(GstEGLRect *rect, gint width, gint height)
+{
+  gint right = MIN(GST_ROUND_UP_2(rect->x + rect->width), width);
+  gint bottom = MIN(GST_ROUND_UP_2(rect->y + rect->height), height);
+  rect->x &= ~1;
+  rect->y &= ~1;
+  rect->width = right - rect->x;
+  rect->height = bottom - rect->y;
+}
+
+static void
+copy_planar_yuv420(const GstEGLConvertKernels *kernels, GstEGLConvertPool *pool,
+        gpointer src, gpointer dst, gint width, gint height, gint dst_stride,
+        GstEGLRect rect)
 {
-  gchar *dstline, *srcline;
-  gint i;
+  GstEGLConvertOp ops[3];
   gint src_stride = GST_ROUND_UP_4(width);
   gint src_height = GST_ROUND_UP_2(height);
   gint uv_src_stride = GST_ROUND_UP_8(width)/2;
@@ -329,60 +416,42 @@ copy_planar_yuv420(gpointer src, gpointer dst, gint width,
   gchar *dst_u = (gchar*)(((guint32)dst + y_dst_size + 4095)&(~4095));
   gchar *dst_v = (gchar*)(((guint32)dst_u + uv_dst_size + 4095)&(~4095));
 
-  GST_INFO("==== copy planar yuv420: [%d, %d], dst_stride %d\n", width, height, dst_stride);
+  align_rect_420(&rect, width, height);
+  GST_INFO("==== copy planar yuv420: [%d, %d], dst_stride %d, rect [%d, %d, %d, %d]\n",
+      width, height, dst_stride, rect.x, rect.y, rect.width, rect.height);
   GST_INFO("==== copy planar yuv420: src yuv virtual addr:[%p, %p, %p]", src, src_u, src_v);
   GST_INFO("==== copy planar yuv420: dst yuv virtual addr:[%p, %p, %p]", dst, dst_u, dst_v);
 
-  srcline = src;
-  dstline = dst;
-  for(i=0; i<height; i++) 	//Y
-  {
-	memcpy(dstline, srcline, src_stride);
-	dstline += dst_stride;
-	srcline += src_stride;
-  }
-  srcline = src_u;
-  dstline = dst_u;
-  for(i=0; i<uv_src_height; i++) //U
-  {
-    memcpy(dstline, srcline, uv_src_stride);
-	dstline += uv_dst_stride;
-	srcline += uv_src_stride;
-  }
-  srcline = src_v;
-  dstline = dst_v;
-  for(i=0; i<uv_src_height; i++) //V
-  {
-    memcpy(dstline, srcline, uv_src_stride);
-	dstline += uv_dst_stride;
-	srcline += uv_src_stride;
-  }
+  //the three planes are converted in one go, sliced across the pool
+  set_plane_op(&ops[0], kernels->copy_rows, dst, dst_stride, src, src_stride,
+      &rect, 1, 1);  //Y
+  set_plane_op(&ops[1], kernels->copy_rows, dst_u, uv_dst_stride, src_u, uv_src_stride,
+      &rect, 2, 1);  //U
+  set_plane_op(&ops[2], kernels->copy_rows, dst_v, uv_dst_stride, src_v, uv_src_stride,
+      &rect, 2, 1);  //V
+  gst_egl_convert_run(pool, ops, 3);
 }
 
 static void
-copy_rgba8888(gpointer src, gpointer dst, gint width,
-        gint height, gint stride)
+copy_rgba8888(const GstEGLConvertKernels *kernels, GstEGLConvertPool *pool,
+        gpointer src, gpointer dst, gint width, gint height, gint stride,
+        GstEGLRect rect)
 {
-  gchar *dstline, *srcline;
+  GstEGLConvertOp op;
   gint src_stride = width*4;
-  gint i;
-  dstline = dst;
-  srcline = src;
-  GST_INFO("==== copy rgb32: [%d, %d], stride %d\n", width, height, stride);
-  for(i=0; i<height; i++) 	//Y
-  {
-    memcpy(dstline, srcline, src_stride);
-    dstline += stride;
-    srcline += src_stride;
-  }
+  GST_INFO("==== copy rgb32: [%d, %d], stride %d, rect [%d, %d, %d, %d]\n",
+      width, height, stride, rect.x, rect.y, rect.width, rect.height);
+  set_plane_op(&op, kernels->copy_rows, dst, stride, src, src_stride,
+      &rect, 1, 4);
+  gst_egl_convert_run(pool, &op, 1);
 }
 
 static void
-convert_i420_yv12(gpointer src, gpointer dst, gint width,
-		gint height, gint dst_stride)
+convert_i420_yv12(const GstEGLConvertKernels *kernels, GstEGLConvertPool *pool,
+        gpointer src, gpointer dst, gint width, gint height, gint dst_stride,
+        GstEGLRect rect)
 {
-  gchar *dstline, *srcline;
-  gint i;
+  GstEGLConvertOp ops[3];
   gint src_stride = GST_ROUND_UP_4(width);
   gint src_height = GST_ROUND_UP_2(height);
   gint uv_src_stride = GST_ROUND_UP_8(width)/2;
@@ -399,73 +468,61 @@ convert_i420_yv12(gpointer src, gpointer dst, gint width,
   gchar *dst_v = (gchar*)(((guint32)dst + y_dst_size + 4095)&(~4095));
   gchar *dst_u = (gchar*)(((guint32)dst_v + uv_dst_size + 4095)&(~4095));
 
-  GST_INFO("==== convert_i420_yv12: [%d, %d], src_stride %d, dst_stride %d", width, height, src_stride, dst_stride);
+  align_rect_420(&rect, width, height);
+  GST_INFO("==== convert_i420_yv12: [%d, %d], src_stride %d, dst_stride %d, rect [%d, %d, %d, %d]",
+      width, height, src_stride, dst_stride, rect.x, rect.y, rect.width, rect.height);
   GST_INFO("==== convert_i420_yv12: src yuv virtual addr:[%p, %p, %p]", src, src_u, src_v);
   GST_INFO("==== convert_i420_yv12: dst yuv virtual addr:[%p, %p, %p]", dst, dst_v, dst_u);
 
-  srcline = src;
-  dstline = dst;
-  for(i=0; i<height; i++) 	//Y
-  {
-    memcpy(dstline, srcline, src_stride);
-    dstline += dst_stride;
-    srcline += src_stride;
-  }
-  srcline = src_u;
-  dstline = dst_u;
-  for(i=0; i<uv_src_height; i++) //U
-  {
-    memcpy(dstline, srcline, uv_src_stride);
-    dstline += uv_dst_stride;
-    srcline += uv_src_stride;
-  }
-  srcline = src_v;
-  dstline = dst_v;
-  for(i=0; i<uv_src_height; i++) //V
-  {
-    memcpy(dstline, srcline, uv_src_stride);
-    dstline += uv_dst_stride;
-    srcline += uv_src_stride;
-  }
+  //the three planes are converted in one go, sliced across the pool
+  set_plane_op(&ops[0], kernels->copy_rows, dst, dst_stride, src, src_stride,
+      &rect, 1, 1);  //Y
+  set_plane_op(&ops[1], kernels->copy_rows, dst_u, uv_dst_stride, src_u, uv_src_stride,
+      &rect, 2, 1);  //U
+  set_plane_op(&ops[2], kernels->copy_rows, dst_v, uv_dst_stride, src_v, uv_src_stride,
+      &rect, 2, 1);  //V
+  gst_egl_convert_run(pool, ops, 3);
 }
 
 static void
-convert_rgbx_rgba(gpointer src, gpointer dst, gint width,
-		gint height, gint dst_stride)
+convert_rgbx_rgba(const GstEGLConvertKernels *kernels, GstEGLConvertPool *pool,
+        gpointer src, gpointer dst, gint width, gint height, gint dst_stride,
+        GstEGLRect rect)
 {
-  gchar *dstline, *srcline;
+  GstEGLConvertOp op;
   gint src_stride = width*4;
-  gint i, j;
-  dstline = dst;
-  srcline = src;
-  GST_INFO("==== convert_rgbx_rgba: [%d, %d], stride %d\n", width, height, dst_stride);
-  for(i=0; i<height; i++) 	//Y
-  {
-    gchar *x = dstline;
-    memcpy(dstline, srcline, src_stride);
-    for(j=0; j<width; j++) {
-      *(x+3) = 0xFF;
-      x+=4;
-    }
-    dstline += dst_stride;
-    srcline += src_stride;
-  }
+  GST_INFO("==== convert_rgbx_rgba: [%d, %d], stride %d, rect [%d, %d, %d, %d], %s kernels\n",
+      width, height, dst_stride, rect.x, rect.y, rect.width, rect.height,
+      kernels->name);
+  set_plane_op(&op, kernels->fill_alpha_rows, dst, dst_stride, src, src_stride,
+      &rect, 1, 4);
+  //fill_alpha_rows counts pixels
+  op.row_bytes = rect.width;
+  op.unit = 4;
+  gst_egl_convert_run(pool, &op, 1);
 }
 
 gboolean
 gst_egl_platform_convert_color_space(gpointer src, GstVideoFormat srcfmt, gpointer dst,
-		GstVideoFormat dstfmt, gint width, gint height, gint stride)
+		GstVideoFormat dstfmt, gint width, gint height, gint stride,
+		const GstEGLRect *rect, const GstEGLConvertKernels *kernels,
+		GstEGLConvertPool *pool)
 {
   gboolean ret = TRUE;
+  GstEGLRect frame = { 0, 0, width, height };
+  if(rect)
+    frame = *rect;
+  if(!kernels)
+    kernels = gst_egl_convert_get_kernels();
   if((srcfmt == GST_VIDEO_FORMAT_I420 && dstfmt == GST_VIDEO_FORMAT_YV12) ||
   	 (srcfmt == GST_VIDEO_FORMAT_YV12 && dstfmt == GST_VIDEO_FORMAT_I420))
-    convert_i420_yv12(src, dst, width, height, stride);
+    convert_i420_yv12(kernels, pool, src, dst, width, height, stride, frame);
   else if(srcfmt == dstfmt)
   {
     if(IS_PLANAR_YUV420(srcfmt))
-      copy_planar_yuv420(src, dst, width, height, stride);
+      copy_planar_yuv420(kernels, pool, src, dst, width, height, stride, frame);
     else if(IS_RGB32(srcfmt))
-      copy_rgba8888(src, dst, width, height, stride);
+      copy_rgba8888(kernels, pool, src, dst, width, height, stride, frame);
     else
     {
       GST_ERROR("Cannot copy format %d", srcfmt);
@@ -474,7 +531,7 @@ gst_egl_platform_convert_color_space(gpointer src, GstVideoFormat srcfmt, gpoint
   }
   else if((srcfmt == GST_VIDEO_FORMAT_RGBx && dstfmt == GST_VIDEO_FORMAT_RGBA) ||
           (srcfmt == GST_VIDEO_FORMAT_BGRx && dstfmt == GST_VIDEO_FORMAT_BGRA))
-    convert_rgbx_rgba(src, dst, width, height, stride);
+    convert_rgbx_rgba(kernels, pool, src, dst, width, height, stride, frame);
   else
   {
     GST_ERROR("Cannot convert color space from %d to %d", srcfmt, dstfmt);
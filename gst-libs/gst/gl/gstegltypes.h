@@ -17,12 +17,22 @@ typedef struct {
   gint           width;
   gint           height;
   gint           stride;
+  gsize          size;    /* bytes backing the image */
+  GstClockTime   last_used;  /* when it went back to the pool */
   GLuint         texture;
   EGLImageKHR    image;
   gpointer       data;    /* virtual */
   gpointer       hw_meta;
 } GstEGLTexture;
 
+/* Part of a frame, in pixels */
+typedef struct {
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+} GstEGLRect;
+
 typedef gboolean      (*EGLSetCapsCB)   (GstCaps *caps, gpointer data);
 typedef GstBuffer*    (*EGLGetBufferCB) (GstCaps *caps, guint size, gpointer data);
 typedef GstFlowReturn (*EGLDrawCB)      (GstBuffer *buf, gpointer data);
@@ -25,6 +25,7 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <gst/video/gstvideosink.h>
 #include <GLES2/gl2.h>
 #define GL_GLEXT_PROTOTYPES
@@ -58,6 +59,13 @@ GST_DEBUG_CATEGORY_STATIC (gst_gl_display_debug);
 #define DEBUG_INIT(bla) \
   GST_DEBUG_CATEGORY_INIT (gst_gl_display_debug, "gldisplay", 0, "opengl display");
 
+//past the context setup, every gl call of the display is made through
+//GL_CALL, which counts it in glstate.calls for the gl-calls-per-frame stat
+#define GL_CALL(display, call) G_STMT_START { \
+  (display)->glstate.calls++;                 \
+  call;                                       \
+} G_STMT_END
+
 enum
 {
     RESIZE_SIGNAL = 0,
@@ -76,24 +84,106 @@ static void gst_gl_display_finalize (GObject * object);
 /* Called in the gl thread, protected by lock and unlock */
 gpointer gst_gl_display_thread_create_context (GstGLDisplay * display);
 void gst_gl_display_thread_destroy_context (GstGLDisplay * display);
-void gst_gl_display_thread_gen_texture (GstEGLBuffer * buffer);
+void gst_gl_display_thread_gen_texture (gpointer data);
 void gst_gl_display_thread_del_textures (GstGLDisplay *display);
-void gst_gl_display_thread_init_redisplay (GstGLDisplay * display);
+gboolean gst_gl_display_thread_init_redisplay (GstGLDisplay * display,
+    GstVideoFormat format);
 void gst_gl_display_thread_on_resize (GstGLDisplay * display);
 void gst_gl_display_thread_do_upload (GstEGLBuffer * buffer);
+void gst_gl_display_thread_do_upload_async (GstEGLBuffer * buffer);
+void gst_gl_display_thread_prealloc_textures (gpointer data);
+void gst_gl_display_thread_release_frames (GstGLDisplay * display);
 
 /* private methods */
 void gst_gl_display_lock (GstGLDisplay * display);
 void gst_gl_display_unlock (GstGLDisplay * display);
 void gst_gl_display_on_resize (GstGLDisplay * display, gint width, gint height);
+static void gst_gl_display_set_viewport (GstGLDisplay * display);
+static gboolean gst_gl_display_update_geometry (GstGLDisplay * display,
+    GstEGLBuffer * buffer);
+static void gst_gl_display_glbind_quad (GstGLDisplay * display);
+static gboolean gst_gl_display_push_frame (GstGLDisplay * display,
+    GstEGLBuffer * buffer);
+static GstEGLBuffer *gst_gl_display_pop_frame (GstGLDisplay * display);
+
+/* gl state tracker, called in the gl thread */
+static void gst_gl_display_glstate_invalidate (GstGLDisplay * display);
+static void gst_gl_display_glstate_use_program (GstGLDisplay * display,
+    GstGLShader * shader);
+static void gst_gl_display_glstate_enable_target (GstGLDisplay * display,
+    GLenum target);
+static void gst_gl_display_glstate_bind_texture (GstGLDisplay * display,
+    GLenum target, GLuint texture);
+static void gst_gl_display_glstate_bind_buffer (GstGLDisplay * display,
+    GLenum target, GLuint buffer);
+static void gst_gl_display_glstate_enable_attrib (GstGLDisplay * display,
+    GLint location);
 void gst_gl_display_on_draw (GstGLDisplay * display);
 void gst_gl_display_on_draw_finish (GstGLDisplay * display);
 void gst_gl_display_on_close (GstGLDisplay * display);
-void gst_gl_display_glgen_texture (GstEGLBuffer *buffer);
+void gst_gl_display_on_timeout (GstGLDisplay * display);
+gboolean gst_gl_display_glgen_texture (GstEGLBuffer *buffer);
+GstEGLTexture *gst_gl_display_glnew_texture (GstGLDisplay * display,
+    GstVideoFormat format, gint width, gint height);
 void gst_gl_display_gldel_texture (gpointer data, gpointer user_data);
 
 void gst_gl_display_thread_do_upload_fill (GstEGLBuffer * buffer);
 
+/* texture pool, protected by texlock */
+struct _GstGLDisplayTexBucket
+{
+  GstVideoFormat format;
+  gint width;
+  gint height;
+  GQueue textures;    //idle textures, oldest first
+  GList lru_link;     //link in display->free_lru
+};
+
+static guint gst_gl_display_tex_bucket_hash (gconstpointer key);
+static gboolean gst_gl_display_tex_bucket_equal (gconstpointer a, gconstpointer b);
+static void gst_gl_display_tex_bucket_free (gpointer data);
+static GstEGLTexture *gst_gl_display_pool_pop (GstGLDisplay * display,
+    GstVideoFormat format, gint width, gint height);
+static GstEGLTexture *gst_gl_display_pool_pop_lru (GstGLDisplay * display);
+static GstEGLTexture *gst_gl_display_bucket_pop (GstGLDisplay * display,
+    GstGLDisplayTexBucket * bucket, gboolean oldest);
+static void gst_gl_display_pool_push (GstGLDisplay * display, GstEGLTexture * info);
+static gboolean gst_gl_display_pool_has_room (GstGLDisplay * display, gsize size);
+
+/* compiled redisplay programs, one per format and variant, kept for the
+ * lifetime of the context */
+struct _GstGLDisplayProgram
+{
+  GstVideoFormat format;
+  guint variant;
+  GstGLShader *shader;
+  GLint attr_position_loc;
+  GLint attr_texture_loc;
+  GstGLShaderUniform *texture_uniform;
+};
+
+static guint gst_gl_display_program_hash (gconstpointer key);
+static gboolean gst_gl_display_program_equal (gconstpointer a, gconstpointer b);
+static void gst_gl_display_program_free (gpointer data);
+static void gst_gl_display_pool_expire (GstGLDisplay * display);
+static void gst_gl_display_start_expire_timer (GstGLDisplay * display,
+    GstGLWindow * window);
+
+typedef struct
+{
+  GstEGLBuffer *buffer;
+  gboolean failed;
+} GstGLDisplayGenTexture;
+
+typedef struct
+{
+  GstGLDisplay *display;
+  GstVideoFormat format;
+  gint width;
+  gint height;
+  gint count;
+} GstGLDisplayPrealloc;
+
 
 //------------------------------------------------------------
 //---------------------- For klass GstGLDisplay ---------------
@@ -148,6 +238,8 @@ gst_gl_display_class_init (GstGLDisplayClass * klass)
 static void
 gst_gl_display_init (GstGLDisplay * display, GstGLDisplayClass * klass)
 {
+  gint i;
+
   GST_INFO("begin");
   //thread safe
   display->mutex = g_mutex_new ();
@@ -164,15 +256,47 @@ gst_gl_display_init (GstGLDisplay * display, GstGLDisplayClass * klass)
 
   //action redisplay
   display->alloc_count = 0;
-  display->free_textures = NULL;
-  display->todraw = NULL;
+  display->free_textures = g_hash_table_new_full (gst_gl_display_tex_bucket_hash,
+      gst_gl_display_tex_bucket_equal, NULL, gst_gl_display_tex_bucket_free);
+  g_queue_init (&display->free_lru);
+  display->free_count = 0;
+  display->pool_bytes = 0;
+  display->max_pool_bytes = 0;
+  display->alloc_timeout = -1;
+  display->alloc_fallbacks = 0;
+  display->idle_timeout = 0;
+  display->stat_hits = 0;
+  display->stat_misses = 0;
+  display->stat_mismatch_deletes = 0;
+  display->stat_waits = 0;
+  display->stat_wait_time = 0;
+  display->stat_peak_alloc = 0;
+  display->stat_bytes_allocated = 0;
+  display->stat_bulk_planes = 0;
+  display->stat_row_planes = 0;
+  for (i = 0; i < GST_GL_DISPLAY_MAX_QUEUED_FRAMES; i++)
+    display->ring[i] = NULL;
+  display->ring_head = 0;
+  display->ring_tail = 0;
+  display->frame_waiters = 0;
+  display->max_queued_frames = 1;
+  display->presenting = NULL;
   display->drawing = NULL;
+  display->present_mode = GST_GL_DISPLAY_PRESENT_FIFO;
+  display->frames_dropped = 0;
+  display->upload_threads = 1;
+  display->convert_pool = NULL;
+  display->convert_pool_threads = 0;
+  display->upload_copy = GST_GL_DISPLAY_UPLOAD_COPY_STREAMING;
+  display->upload_kernels = NULL;
   display->cond_tex = g_cond_new();
   display->cond_disp = g_cond_new();
   display->keep_aspect_ratio = FALSE;
   display->redisplay_format = GST_VIDEO_FORMAT_UNKNOWN;
   display->tex_width = 1;
   display->tex_height = 1;
+  display->surface_width = 0;
+  display->surface_height = 0;
   display->crop_left = 0;
   display->crop_right = 0;
   display->crop_top = 0;
@@ -181,11 +305,19 @@ gst_gl_display_init (GstGLDisplay * display, GstGLDisplayClass * klass)
   display->sampler_right = 1.0f;
   display->sampler_top = 1.0f;
   display->sampler_bottom = 0.0f;
-  display->vertex_src = NULL;
-  display->fragment_src = NULL;
   display->redisplay_shader = NULL;
+  display->shader_cache = g_hash_table_new_full (gst_gl_display_program_hash,
+      gst_gl_display_program_equal, NULL, gst_gl_display_program_free);
+  display->shader_cache_dir = NULL;
   display->redisplay_attr_position_loc = 0;
   display->redisplay_attr_texture_loc = 0;
+  display->redisplay_texture_uniform = NULL;
+  display->redisplay_vbo = 0;
+  display->redisplay_ibo = 0;
+  display->redisplay_vbo_dirty = TRUE;
+  gst_gl_display_glstate_invalidate (display);
+  display->glstate.calls = 0;
+  display->glstate.calls_last_frame = 0;
 
   //foreign gl context
   display->external_gl_context = 0;
@@ -205,6 +337,7 @@ gst_gl_display_finalize (GObject * object)
     gst_gl_window_set_resize_callback (display->gl_window, NULL, NULL);
     gst_gl_window_set_draw_callback (display->gl_window, NULL, NULL, NULL);
     gst_gl_window_set_close_callback (display->gl_window, NULL, NULL);
+    gst_gl_window_set_timeout_callback (display->gl_window, NULL, NULL, 0);
 
     GST_INFO ("send quit gl window loop");
 
@@ -228,6 +361,11 @@ gst_gl_display_finalize (GObject * object)
     display->gl_thread = NULL;
   }
 
+  if (display->convert_pool) {
+    gst_egl_convert_pool_free (display->convert_pool);
+    display->convert_pool = NULL;
+  }
+
   if (display->mutex) {
     g_mutex_free (display->mutex);
     display->mutex = NULL;
@@ -252,8 +390,15 @@ gst_gl_display_finalize (GObject * object)
     g_cond_free (display->cond_tex);
     display->cond_tex = NULL;
   }
-  g_free(display->vertex_src);
-  g_free(display->fragment_src);
+  if (display->free_textures) {
+    g_hash_table_destroy (display->free_textures);
+    display->free_textures = NULL;
+  }
+  if (display->shader_cache) {
+    g_hash_table_destroy (display->shader_cache);
+    display->shader_cache = NULL;
+  }
+  g_free (display->shader_cache_dir);
   GST_INFO("gst_gl_display_finalize finish");
 }
 
@@ -325,6 +470,11 @@ gst_gl_display_thread_create_context (GstGLDisplay * display)
 
   gst_gl_display_unlock (display);
 
+  //a pool-idle-timeout set before the window existed
+  g_mutex_lock (display->texlock);
+  gst_gl_display_start_expire_timer (display, window);
+  g_mutex_unlock (display->texlock);
+
   gst_gl_window_run_loop (display->gl_window);
 
   GST_INFO ("loop exited\n");
@@ -348,10 +498,16 @@ gst_gl_display_thread_create_context (GstGLDisplay * display)
 void
 gst_gl_display_thread_destroy_context (GstGLDisplay * display)
 {
-  if (display->redisplay_shader) {
-    g_object_unref (G_OBJECT (display->redisplay_shader));
-    display->redisplay_shader = NULL;
+  //the programs and buffer objects belong to this context
+  if (display->redisplay_vbo) {
+    GL_CALL (display, glDeleteBuffers (1, &display->redisplay_vbo));
+    GL_CALL (display, glDeleteBuffers (1, &display->redisplay_ibo));
+    display->redisplay_vbo = 0;
+    display->redisplay_ibo = 0;
   }
+  display->redisplay_shader = NULL;
+  gst_gl_display_glstate_invalidate (display);
+  g_hash_table_remove_all (display->shader_cache);
   GST_INFO ("Context destroyed");
 }
 
@@ -386,56 +542,34 @@ align_buffer_size(GstVideoFormat format, gint *width, gint *height,
 
 static GstEGLBuffer*
 gst_gl_display_alloc_new_buffer(GstGLDisplay * display, GstVideoFormat format,
-    gint width, gint height, gint left, gint right, gint top, gint bottom)
+    gint width, gint height, gint left, gint right, gint top, gint bottom,
+    gboolean wait, GstGLDisplayAllocResult *result)
 {
   GstEGLBuffer *buf;
   align_buffer_size(format, &width, &height, &right, &bottom);  //hack for current gpu driver
 
-  gst_gl_display_lock(display);
-  if(format != display->redisplay_format ||  //new video format
-      width != display->tex_width || height != display->tex_height ||
-      left != display->crop_left || right != display->crop_right ||
-      top != display->crop_top || bottom != display->crop_bottom)
-  {
-    display->redisplay_format = format;
-    display->tex_width = width;
-    display->tex_height = height;
-    display->crop_left = left;
-    display->crop_right = right;
-    display->crop_top = top;
-    display->crop_bottom = bottom;
-    display->sampler_left   = ((gfloat)left)/width;
-    display->sampler_right  = ((gfloat)(width-right))/width;
-    display->sampler_top    = ((gfloat)(height-bottom))/height;
-    display->sampler_bottom = ((gfloat)top)/height;
-    
-    if (display->todraw) {
-      gst_egl_buffer_unref(display->todraw);
-      display->todraw = NULL;
-    }
-    if (display->drawing) {
-      gst_egl_buffer_unref(display->drawing);
-      display->drawing = NULL;
-    }
-    if(display->redisplay_shader)
-    {
-      gst_gl_shader_use (NULL);
-      g_object_unref (G_OBJECT (display->redisplay_shader));
-      display->redisplay_shader = NULL;
-    }
-    g_cond_signal(display->cond_disp);
-  }
-  gst_gl_display_unlock(display);
-
-  buf = gst_egl_buffer_new(display, NULL, NULL, NULL, format, width, height);
+  //the geometry travels with the buffer, the frame on screen stays valid
+  //until the gl thread draws one with the new geometry
+  buf = gst_egl_buffer_new(NULL, NULL, NULL, NULL, format, width, height);
+  buf->display = g_object_ref (display);
+  *result = gst_gl_display_gen_texture (display, buf, wait);
+  gst_egl_buffer_map_texture (buf);
+  buf->crop_left = left;
+  buf->crop_right = right;
+  buf->crop_top = top;
+  buf->crop_bottom = bottom;
   
   return buf;
 }
 
+/* Without wait the pool is only looked at once, result (can be NULL)
+ * tells a full pool from a failure when no buffer is returned */
 GstEGLBuffer*
-gst_gl_display_get_free_buffer(GstGLDisplay * display, GstCaps *caps, guint size, gboolean check_platform)
+gst_gl_display_get_free_buffer(GstGLDisplay * display, GstCaps *caps, guint size,
+    gboolean check_platform, gboolean wait, GstGLDisplayAllocResult *result)
 {
   GstEGLBuffer *ret = NULL;
+  GstGLDisplayAllocResult res = GST_GL_DISPLAY_ALLOC_FAILED;
   GstVideoFormat format;
   gint width;
   gint height;
@@ -457,13 +591,14 @@ gst_gl_display_get_free_buffer(GstGLDisplay * display, GstCaps *caps, guint size
   if(size != -1 && gst_video_format_get_size(format, alloc_width, alloc_height) != size)
   {
     GST_WARNING("can't allocate buffer format:%d, width, height: [%d, %d] while size %d", format, alloc_width, alloc_height, size);
-    return NULL;
+    goto done;
   }
 
   if(check_platform && !gst_egl_platform_accept_caps(format, alloc_width, alloc_height))
-    return NULL;
+    goto done;
   
-  ret = gst_gl_display_alloc_new_buffer(display, format, alloc_width, alloc_height, left, right, top, bottom);
+  ret = gst_gl_display_alloc_new_buffer(display, format, alloc_width, alloc_height,
+      left, right, top, bottom, wait, &res);
   if(ret->texinfo)
     GST_BUFFER_CAPS(ret) = gst_caps_ref(caps);
   else
@@ -472,70 +607,168 @@ gst_gl_display_get_free_buffer(GstGLDisplay * display, GstCaps *caps, guint size
     ret = NULL;
   }
   GST_INFO("Got buf %p", ret);
+done:
+  if(result)
+    *result = res;
   return ret;
 }
 
 /* Called in the gl thread */
 void
-gst_gl_display_thread_gen_texture (GstEGLBuffer * buffer)
+gst_gl_display_thread_gen_texture (gpointer data)
 {
+  GstGLDisplayGenTexture *gen = (GstGLDisplayGenTexture *) data;
   //setup a texture to render to (this one will be in a gl buffer)
-  gst_gl_display_glgen_texture (buffer);
+  gen->failed = !gst_gl_display_glgen_texture (gen->buffer);
 }
 
 void
 gst_gl_display_thread_del_textures (GstGLDisplay *display)
 {
+  GstEGLTexture *info;
+  g_mutex_lock(display->texlock);
+  while((info = gst_gl_display_pool_pop_lru(display)))
+    gst_gl_display_gldel_texture(info, display);
+  g_mutex_unlock(display->texlock);
+}
+
+/* Fill the pool up to count idle textures of one geometry in a single
+ * gl thread job, idle textures of other geometries are evicted if needed
+ * Called in the gl thread */
+void
+gst_gl_display_thread_prealloc_textures (gpointer data)
+{
+  GstGLDisplayPrealloc *prealloc = (GstGLDisplayPrealloc *) data;
+  GstGLDisplay *display = prealloc->display;
+  GstGLDisplayTexBucket key;
+  GstGLDisplayTexBucket *bucket;
+  GstEGLTexture *info;
+  GList *lru;
+  gint count = prealloc->count;
+  gsize size = gst_egl_platform_get_image_size(prealloc->format,
+      prealloc->width, prealloc->height);
+
+  key.format = prealloc->format;
+  key.width = prealloc->width;
+  key.height = prealloc->height;
+
   g_mutex_lock(display->texlock);
-  if(display->free_textures)
+  bucket = g_hash_table_lookup(display->free_textures, &key);
+  if(bucket)
+    count -= g_queue_get_length(&bucket->textures);
+  while(count > 0)
   {
-    g_list_foreach (display->free_textures, gst_gl_display_gldel_texture, display);
-    g_list_free(display->free_textures);
-    display->free_textures = NULL;
+    if(!gst_gl_display_pool_has_room(display, size))
+    {
+      //evict the least recently used other geometry, the bucket being
+      //preallocated has a single link in free_lru and is skipped
+      lru = g_queue_peek_head_link(&display->free_lru);
+      if(lru && gst_gl_display_tex_bucket_equal(lru->data, &key))
+        lru = lru->next;
+      if(!lru)
+        break;
+      gst_gl_display_gldel_texture(gst_gl_display_bucket_pop(display, lru->data, TRUE), display);
+      display->stat_mismatch_deletes++;
+      continue;
+    }
+    info = gst_gl_display_glnew_texture(display, key.format, key.width, key.height);
+    if(!info)
+      break;
+    gst_gl_display_pool_push(display, info);
+    count--;
   }
+  GST_INFO("prealloc %d textures [%d, %d] format %d, %d missing", prealloc->count,
+      key.width, key.height, key.format, count);
   g_mutex_unlock(display->texlock);
 }
 
-/* Called in the gl thread */
-void
-gst_gl_display_thread_init_redisplay (GstGLDisplay * display)
+/* Compile the redisplay program of a format, NULL on error
+ * Called in the gl thread */
+static GstGLDisplayProgram *
+gst_gl_display_glnew_program (GstGLDisplay * display, GstVideoFormat format,
+    guint variant)
 {
   GError *error = NULL;
-  gst_gl_display_lock(display);
-  if(display->redisplay_shader)
-  { //already initialized
-    gst_gl_display_unlock(display);
-    return;
-  }
-  g_free(display->vertex_src);
-  g_free(display->fragment_src);
-   
-  display->redisplay_shader = gst_gl_shader_new ();
-  display->vertex_src = gst_egl_platform_get_vertex_source(display->redisplay_format);
-  display->fragment_src = gst_egl_platform_get_fragment_source(display->redisplay_format);
- 
-  GST_INFO("vertex source:\n%s", display->vertex_src);
-  GST_INFO("fragment source:\n%s", display->fragment_src);
-
-  gst_gl_shader_set_vertex_source (display->redisplay_shader, display->vertex_src);
-  gst_gl_shader_set_fragment_source (display->redisplay_shader, display->fragment_src);
-
-  gst_gl_shader_compile (display->redisplay_shader, &error);
+  GstGLDisplayProgram *program;
+  gchar *vertex_src = gst_egl_platform_get_vertex_source(format);
+  gchar *fragment_src = gst_egl_platform_get_fragment_source(format);
+  GstGLShader *shader = gst_gl_shader_new ();
+
+  GST_INFO("vertex source:\n%s", vertex_src);
+  GST_INFO("fragment source:\n%s", fragment_src);
+
+  gst_gl_shader_set_vertex_source (shader, vertex_src);
+  gst_gl_shader_set_fragment_source (shader, fragment_src);
+  gst_gl_shader_set_binary_cache_dir (shader, display->shader_cache_dir);
+  g_free(vertex_src);
+  g_free(fragment_src);
+
+  gst_gl_shader_compile (shader, &error);
   if (error) {
     GST_ERROR ("%s", error->message);
     g_error_free (error);
-    error = NULL;
-    gst_gl_shader_use (NULL);
-    display->isAlive = FALSE;
-  } else {
-    display->redisplay_attr_position_loc =
-        gst_gl_shader_get_attribute_location (display->redisplay_shader,
-        "a_position");
-    display->redisplay_attr_texture_loc =
-        gst_gl_shader_get_attribute_location (display->redisplay_shader,
-        "a_texCoord");
+    GL_CALL (display, gst_gl_shader_use (NULL));
+    g_object_unref (G_OBJECT (shader));
+    return NULL;
   }
-  gst_gl_display_unlock(display);
+
+  program = g_slice_new0(GstGLDisplayProgram);
+  program->format = format;
+  program->variant = variant;
+  program->shader = shader;
+  program->attr_position_loc =
+      gst_gl_shader_get_attribute_location (shader, "a_position");
+  program->attr_texture_loc =
+      gst_gl_shader_get_attribute_location (shader, "a_texCoord");
+  program->texture_uniform = gst_gl_shader_get_uniform (shader, "s_texture");
+
+  //the sampler stays on texture unit 0, uniforms are program state so it is
+  //set once here rather than for every frame
+  gst_gl_display_glstate_use_program (display, shader);
+  GL_CALL (display, gst_gl_shader_set_uniform_1i_handle (shader,
+          program->texture_uniform, 0));
+  GST_INFO("compiled redisplay program for format %d, variant %u", format, variant);
+  return program;
+}
+
+/* Select the redisplay program of format, compiling it only the first time
+ * the format is seen by this context
+ * Called in the gl thread */
+gboolean
+gst_gl_display_thread_init_redisplay (GstGLDisplay * display,
+    GstVideoFormat format)
+{
+  GstGLDisplayProgram key;
+  GstGLDisplayProgram *program;
+
+  if(display->redisplay_shader && display->redisplay_format == format)
+    return TRUE;  //already initialized
+
+  key.format = format;
+  key.variant = 0;
+  program = g_hash_table_lookup(display->shader_cache, &key);
+  if(!program)
+  {
+    program = gst_gl_display_glnew_program(display, format, key.variant);
+    if(!program)
+    {
+      gst_gl_display_glstate_invalidate(display);
+      display->redisplay_shader = NULL;
+      display->isAlive = FALSE;
+      return FALSE;
+    }
+    g_hash_table_insert(display->shader_cache, program, program);
+  }
+
+  if (program->attr_position_loc != display->redisplay_attr_position_loc ||
+      program->attr_texture_loc != display->redisplay_attr_texture_loc)
+    display->glstate.quad_pointers = 0;
+  display->redisplay_format = format;
+  display->redisplay_shader = program->shader;
+  display->redisplay_attr_position_loc = program->attr_position_loc;
+  display->redisplay_attr_texture_loc = program->attr_texture_loc;
+  display->redisplay_texture_uniform = program->texture_uniform;
+  return TRUE;
 }
 
 void
@@ -551,6 +784,15 @@ gst_gl_display_thread_do_upload (GstEGLBuffer * buffer)
   gst_gl_display_thread_do_upload_fill (buffer);
 }
 
+/* Called by the idle function, drops the ref taken by
+ * gst_gl_display_do_upload_async */
+void
+gst_gl_display_thread_do_upload_async (GstEGLBuffer * buffer)
+{
+  gst_gl_display_thread_do_upload_fill (buffer);
+  gst_egl_buffer_unref (buffer);
+}
+
 //------------------------------------------------------------
 //------------------ BEGIN GL THREAD ACTIONS -----------------
 //------------------------------------------------------------
@@ -579,53 +821,76 @@ void
 gst_gl_display_on_resize (GstGLDisplay * display, gint width, gint height)
 {
     gst_gl_display_lock(display);
-    GST_INFO("!!!!!!!!!!keep aspect ratio %d, [%d, %d]", display->keep_aspect_ratio, width, height);
-    if (display->keep_aspect_ratio) {
-      GstVideoRectangle src, dst, result;
-      GstEGLBuffer *buffer = display->todraw ? display->todraw :
-          (display->drawing ? display->drawing : NULL);
-
-      src.x = 0;
-      src.y = 0;
-      src.w = buffer ? buffer->width : 0;
-      src.h = buffer ? buffer->height : 0;
-
-      dst.x = 0;
-      dst.y = 0;
-      dst.w = width;
-      dst.h = height;
-
-      gst_video_sink_center_rect (src, dst, &result, TRUE);
-      glViewport (result.x, result.y, result.w, result.h);
-      GST_INFO("view port [%d, %d, %d, %d]", result.x, result.y, result.w, result.h);
-    } else {
-      glViewport (0, 0, width, height);
-      GST_INFO("view port [%d, %d, %d, %d]", 0, 0, width, height);
-    }
+    GST_INFO("!!!!!!!!!!keep aspect ratio %d, [%d, %d]",
+        g_atomic_int_get (&display->keep_aspect_ratio), width, height);
+    display->surface_width = width;
+    display->surface_height = height;
+    gst_gl_display_set_viewport(display);
     gst_gl_display_unlock(display);
     g_signal_emit (display, display_signals[RESIZE_SIGNAL], 0);
 }
 
-void
-gst_gl_display_on_draw (GstGLDisplay * display)
+/* Called in the gl thread */
+static void
+gst_gl_display_set_viewport (GstGLDisplay * display)
 {
-  GstEGLBuffer *buffer;
-
-  GST_DEBUG("draw begin");
-  gst_gl_display_lock(display);
-  //check if texture is ready for being drawn
-  if (!display->todraw && !display->drawing)
-  {
-    gst_gl_display_unlock(display);
-    return;
+  gint width = display->surface_width;
+  gint height = display->surface_height;
+
+  if (g_atomic_int_get (&display->keep_aspect_ratio)) {
+    GstVideoRectangle src, dst, result;
+    GstEGLBuffer *buffer = display->presenting ? display->presenting :
+        display->drawing;
+
+    src.x = 0;
+    src.y = 0;
+    src.w = buffer ? buffer->width : 0;
+    src.h = buffer ? buffer->height : 0;
+
+    dst.x = 0;
+    dst.y = 0;
+    dst.w = width;
+    dst.h = height;
+
+    gst_video_sink_center_rect (src, dst, &result, TRUE);
+    GL_CALL (display, glViewport (result.x, result.y, result.w, result.h));
+    GST_INFO("view port [%d, %d, %d, %d]", result.x, result.y, result.w, result.h);
+  } else {
+    GL_CALL (display, glViewport (0, 0, width, height));
+    GST_INFO("view port [%d, %d, %d, %d]", 0, 0, width, height);
   }
+}
 
-  buffer = display->todraw ? display->todraw : display->drawing;
-
-  GST_INFO("------ draw buffer %p", buffer);
+/* Bind the quad buffer objects, creating them the first time and
+ * rewriting the vertices only when the sampler coordinates changed
+ * Called in the gl thread */
+static void
+gst_gl_display_glbind_quad (GstGLDisplay * display)
+{
+  if (!display->redisplay_vbo) {
+    const GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
+
+    GL_CALL (display, glGenBuffers (1, &display->redisplay_vbo));
+    GL_CALL (display, glGenBuffers (1, &display->redisplay_ibo));
+
+    gst_gl_display_glstate_bind_buffer (display, GL_ELEMENT_ARRAY_BUFFER,
+        display->redisplay_ibo);
+    GL_CALL (display, glBufferData (GL_ELEMENT_ARRAY_BUFFER, sizeof (indices),
+            indices, GL_STATIC_DRAW));
+
+    gst_gl_display_glstate_bind_buffer (display, GL_ARRAY_BUFFER,
+        display->redisplay_vbo);
+    GL_CALL (display, glBufferData (GL_ARRAY_BUFFER, 20 * sizeof (GLfloat),
+            NULL, GL_DYNAMIC_DRAW));
+    display->redisplay_vbo_dirty = TRUE;
+  } else {
+    gst_gl_display_glstate_bind_buffer (display, GL_ELEMENT_ARRAY_BUFFER,
+        display->redisplay_ibo);
+    gst_gl_display_glstate_bind_buffer (display, GL_ARRAY_BUFFER,
+        display->redisplay_vbo);
+  }
 
-  {
-    GLenum target = gst_egl_platform_get_target(buffer->format);
+  if (display->redisplay_vbo_dirty) {
     const GLfloat vVertices[] = { 1.0f, 1.0f, 0.0f,
       display->sampler_right, display->sampler_bottom,
       -1.0f, 1.0f, 0.0f,
@@ -636,62 +901,349 @@ gst_gl_display_on_draw (GstGLDisplay * display)
       display->sampler_right, display->sampler_top
     };
 
-    GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
-
-    glClear (GL_COLOR_BUFFER_BIT);
-
-    gst_gl_shader_use (NULL);
-    gst_gl_shader_use (display->redisplay_shader);
+    GL_CALL (display, glBufferSubData (GL_ARRAY_BUFFER, 0, sizeof (vVertices),
+            vVertices));
+    display->redisplay_vbo_dirty = FALSE;
+  }
 
+  //the attrib pointers live in the context, they only need to be set again
+  //for a new vbo or a program with other locations
+  if (display->glstate.quad_pointers != display->redisplay_vbo) {
     //Load the vertex position
-    glVertexAttribPointer (display->redisplay_attr_position_loc, 3, GL_FLOAT,
-        GL_FALSE, 5 * sizeof (GLfloat), vVertices);
+    GL_CALL (display, glVertexAttribPointer (display->redisplay_attr_position_loc,
+            3, GL_FLOAT, GL_FALSE, 5 * sizeof (GLfloat), (const GLvoid *) 0));
 
     //Load the texture coordinate
-    glVertexAttribPointer (display->redisplay_attr_texture_loc, 2, GL_FLOAT,
-        GL_FALSE, 5 * sizeof (GLfloat), &vVertices[3]);
+    GL_CALL (display, glVertexAttribPointer (display->redisplay_attr_texture_loc,
+            2, GL_FLOAT, GL_FALSE, 5 * sizeof (GLfloat),
+            (const GLvoid *) (3 * sizeof (GLfloat))));
+    display->glstate.quad_pointers = display->redisplay_vbo;
+  }
+}
+
+static void
+gst_gl_display_glstate_invalidate (GstGLDisplay * display)
+{
+  GstGLDisplayGLState *state = &display->glstate;
+  state->program_known = FALSE;
+  state->program = NULL;
+  state->enabled_target = G_MAXUINT;
+  state->active_texture = G_MAXUINT;
+  state->texture_target = G_MAXUINT;
+  state->texture = G_MAXUINT;
+  state->array_buffer = G_MAXUINT;
+  state->element_buffer = G_MAXUINT;
+  state->attribs_known = 0;
+  state->attribs_enabled = 0;
+  state->quad_pointers = 0;
+}
+
+static void
+gst_gl_display_glstate_use_program (GstGLDisplay * display, GstGLShader * shader)
+{
+  GstGLDisplayGLState *state = &display->glstate;
+  if (state->program_known && state->program == shader)
+    return;
+  GL_CALL (display, gst_gl_shader_use (shader));
+  state->program_known = TRUE;
+  state->program = shader;
+}
+
+/* only one texture target is enabled at a time */
+static void
+gst_gl_display_glstate_enable_target (GstGLDisplay * display, GLenum target)
+{
+  GstGLDisplayGLState *state = &display->glstate;
+  if (state->enabled_target == target)
+    return;
+  if (state->enabled_target != G_MAXUINT)
+    GL_CALL (display, glDisable (state->enabled_target));
+  GL_CALL (display, glEnable (target));
+  state->enabled_target = target;
+}
+
+/* texture unit 0 is the only one in use */
+static void
+gst_gl_display_glstate_bind_texture (GstGLDisplay * display, GLenum target,
+    GLuint texture)
+{
+  GstGLDisplayGLState *state = &display->glstate;
+  if (state->active_texture != GL_TEXTURE0) {
+    GL_CALL (display, glActiveTexture (GL_TEXTURE0));
+    state->active_texture = GL_TEXTURE0;
+  }
+  if (state->texture_target == target && state->texture == texture)
+    return;
+  GL_CALL (display, glBindTexture (target, texture));
+  state->texture_target = target;
+  state->texture = texture;
+}
+
+static void
+gst_gl_display_glstate_bind_buffer (GstGLDisplay * display, GLenum target,
+    GLuint buffer)
+{
+  GstGLDisplayGLState *state = &display->glstate;
+  GLuint *current = target == GL_ARRAY_BUFFER ? &state->array_buffer :
+      &state->element_buffer;
+  if (*current == buffer)
+    return;
+  GL_CALL (display, glBindBuffer (target, buffer));
+  *current = buffer;
+}
+
+static void
+gst_gl_display_glstate_enable_attrib (GstGLDisplay * display, GLint location)
+{
+  GstGLDisplayGLState *state = &display->glstate;
+  guint32 bit;
+  if (location < 0 || location >= 32) {
+    GL_CALL (display, glEnableVertexAttribArray (location));
+    return;
+  }
+  bit = 1u << location;
+  if ((state->attribs_known & bit) && (state->attribs_enabled & bit))
+    return;
+  GL_CALL (display, glEnableVertexAttribArray (location));
+  state->attribs_known |= bit;
+  state->attribs_enabled |= bit;
+}
+
+/* Make the redisplay state follow the geometry of the buffer about to be
+ * drawn: the shader only changes with the format, the viewport with the
+ * size and the sampler coordinates with the crop
+ * Called in the gl thread */
+static gboolean
+gst_gl_display_update_geometry (GstGLDisplay * display, GstEGLBuffer * buffer)
+{
+  if (!gst_gl_display_thread_init_redisplay (display, buffer->format))
+    return FALSE;
+
+  if (buffer->width != display->tex_width ||
+      buffer->height != display->tex_height) {
+    display->tex_width = buffer->width;
+    display->tex_height = buffer->height;
+    if (g_atomic_int_get (&display->keep_aspect_ratio) &&
+        display->surface_width)
+      gst_gl_display_set_viewport (display);
+    //force the sampler update
+    display->crop_left = -1;
+  }
+
+  if (buffer->crop_left != display->crop_left ||
+      buffer->crop_right != display->crop_right ||
+      buffer->crop_top != display->crop_top ||
+      buffer->crop_bottom != display->crop_bottom) {
+    gint width = buffer->width;
+    gint height = buffer->height;
+    display->crop_left = buffer->crop_left;
+    display->crop_right = buffer->crop_right;
+    display->crop_top = buffer->crop_top;
+    display->crop_bottom = buffer->crop_bottom;
+    display->sampler_left   = ((gfloat)display->crop_left)/width;
+    display->sampler_right  = ((gfloat)(width-display->crop_right))/width;
+    display->sampler_top    = ((gfloat)(height-display->crop_bottom))/height;
+    display->sampler_bottom = ((gfloat)display->crop_top)/height;
+    display->redisplay_vbo_dirty = TRUE;
+  }
+  return TRUE;
+}
+
+/* Queue a frame for the gl thread. In fifo mode wait for room when the
+ * queue is full, in mailbox mode steal the oldest frame from the consumer
+ * instead. Called by the single producer, the streaming thread */
+static gboolean
+gst_gl_display_push_frame (GstGLDisplay * display, GstEGLBuffer * buffer)
+{
+  gint head, tail = g_atomic_int_get (&display->ring_tail);
+
+  while (TRUE) {
+    head = g_atomic_int_get (&display->ring_head);
+    if ((guint) (tail - head) <
+        (guint) g_atomic_int_get (&display->max_queued_frames))
+      break;
+
+    if (g_atomic_int_get (&display->present_mode) ==
+        GST_GL_DISPLAY_PRESENT_MAILBOX) {
+      //whoever wins the CAS owns the frame in the slot
+      if (g_atomic_int_compare_and_exchange (&display->ring_head, head,
+              head + 1)) {
+        GstEGLBuffer *dropped = g_atomic_pointer_get (
+            &display->ring[(guint) head % GST_GL_DISPLAY_MAX_QUEUED_FRAMES]);
+        GST_INFO("###### drop queued buffer %p", dropped);
+        gst_egl_buffer_unref (dropped);
+        g_atomic_int_inc (&display->frames_dropped);
+      }
+      continue;
+    }
+
+    //slow path, wait until on_draw takes a frame
+    gst_gl_display_lock (display);
+    g_atomic_int_set (&display->frame_waiters, 1);
+    while (display->isAlive && (guint) (tail -
+            g_atomic_int_get (&display->ring_head)) >=
+        (guint) g_atomic_int_get (&display->max_queued_frames)) {
+      GST_INFO("###### wait for display finish");
+      g_cond_wait (display->cond_disp, display->mutex);
+    }
+    g_atomic_int_set (&display->frame_waiters, 0);
+    gst_gl_display_unlock (display);
+    if (!display->isAlive)
+      return FALSE;
+  }
+
+  g_atomic_pointer_set (
+      &display->ring[(guint) tail % GST_GL_DISPLAY_MAX_QUEUED_FRAMES],
+      gst_egl_buffer_ref (buffer));
+  g_atomic_int_set (&display->ring_tail, tail + 1);
+  return TRUE;
+}
+
+/* Take the oldest queued frame, NULL if there is none
+ * Called in the gl thread, the single consumer */
+static GstEGLBuffer *
+gst_gl_display_pop_frame (GstGLDisplay * display)
+{
+  GstEGLBuffer *buffer;
+  gint head;
+
+  do {
+    head = g_atomic_int_get (&display->ring_head);
+    if (head == g_atomic_int_get (&display->ring_tail))
+      return NULL;
+    //the slot can only be rewritten once head moved, then the CAS fails
+    buffer = g_atomic_pointer_get (
+        &display->ring[(guint) head % GST_GL_DISPLAY_MAX_QUEUED_FRAMES]);
+  } while (!g_atomic_int_compare_and_exchange (&display->ring_head, head,
+          head + 1));
+
+  if (g_atomic_int_get (&display->frame_waiters)) {
+    gst_gl_display_lock (display);
+    g_cond_signal (display->cond_disp);
+    gst_gl_display_unlock (display);
+  }
+  return buffer;
+}
+
+/* Drop every frame the display holds
+ * Called in the gl thread, or once its loop has exited */
+void
+gst_gl_display_thread_release_frames (GstGLDisplay * display)
+{
+  GstEGLBuffer *buffer;
+
+  while ((buffer = gst_gl_display_pop_frame (display)))
+    gst_egl_buffer_unref (buffer);
+  if (display->presenting) {
+    gst_egl_buffer_unref (display->presenting);
+    display->presenting = NULL;
+  }
+  if (display->drawing) {
+    gst_egl_buffer_unref (display->drawing);
+    display->drawing = NULL;
+  }
+}
+
+void
+gst_gl_display_on_draw (GstGLDisplay * display)
+{
+  GstEGLBuffer *buffer;
 
-    glEnableVertexAttribArray (display->redisplay_attr_position_loc);
-    glEnableVertexAttribArray (display->redisplay_attr_texture_loc);
+  GST_DEBUG("draw begin");
+  //check if texture is ready for being drawn
+  if (!display->presenting)
+    display->presenting = gst_gl_display_pop_frame(display);
+  if (!display->presenting && !display->drawing)
+    return;
+
+  buffer = display->presenting ? display->presenting : display->drawing;
+
+  //the upload job of this frame is still queued behind the jobs the
+  //gl loop has already run, do it now, the job will find nothing to do
+  if (buffer->attach)
+    gst_gl_display_thread_do_upload_fill (buffer);
+
+  GST_INFO("------ draw buffer %p", buffer);
+
+  if (!gst_gl_display_update_geometry(display, buffer))
+    return;
+
+  {
+    GLenum target = gst_egl_platform_get_target(buffer->format);
+
+    GL_CALL (display, glClear (GL_COLOR_BUFFER_BIT));
 
-    glEnable(target);
-    glActiveTexture (GL_TEXTURE0);
-    glBindTexture (target, buffer->texinfo->texture);
-    gst_gl_shader_set_uniform_1i (display->redisplay_shader, "s_texture", 0);
+    gst_gl_display_glstate_use_program (display, display->redisplay_shader);
+
+    gst_gl_display_glbind_quad (display);
+
+    gst_gl_display_glstate_enable_attrib (display,
+        display->redisplay_attr_position_loc);
+    gst_gl_display_glstate_enable_attrib (display,
+        display->redisplay_attr_texture_loc);
+
+    gst_gl_display_glstate_enable_target (display, target);
+    gst_gl_display_glstate_bind_texture (display, target,
+        buffer->texinfo->texture);
 
 	GST_INFO("Draw Element crop: [%f, %f, %f, %f]", display->sampler_top,
 			display->sampler_bottom, display->sampler_left, display->sampler_right);
 	GST_INFO("Texture: format %d, size [%d, %d], stride %d", buffer->texinfo->format,
 			buffer->texinfo->width, buffer->texinfo->height, buffer->texinfo->stride);
 
-    glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
-    glBindTexture (target, 0);
-    glDisable(target);
+    GL_CALL (display, glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_SHORT,
+            (const GLvoid *) 0));
   }
-  gst_gl_display_unlock(display);
   
   //end default opengl scene
-  g_signal_emit (display, display_signals[DRAW_SIGNAL], 0);
+  if (g_signal_has_handler_pending (display, display_signals[DRAW_SIGNAL], 0,
+          FALSE)) {
+    //leave client side arrays usable to the draw signal handlers, and
+    //forget about whatever state they change
+    gst_gl_display_glstate_bind_buffer (display, GL_ARRAY_BUFFER, 0);
+    gst_gl_display_glstate_bind_buffer (display, GL_ELEMENT_ARRAY_BUFFER, 0);
+    g_signal_emit (display, display_signals[DRAW_SIGNAL], 0);
+    gst_gl_display_glstate_invalidate (display);
+  }
   GST_DEBUG("draw finish");
 }
 
 void
 gst_gl_display_on_draw_finish (GstGLDisplay * display)
 {
-  gst_gl_display_lock(display);
-  GST_INFO("------ draw buffer %p finish, last drawing %p", display->todraw, display->drawing);
-  if(display->todraw)
+  GST_INFO("------ draw buffer %p finish, last drawing %p", display->presenting, display->drawing);
+  if(display->presenting)
   {
     if(display->drawing)
       gst_egl_buffer_unref(display->drawing);
-    display->drawing = display->todraw;
-    display->todraw = NULL;
-    g_cond_signal(display->cond_disp);
+    display->drawing = display->presenting;
+    display->presenting = NULL;
   }
-  gst_gl_display_unlock(display);
+
+  g_atomic_int_set (&display->glstate.calls_last_frame,
+      display->glstate.calls);
+  GST_LOG("%u gl calls for the last frame", display->glstate.calls);
+  display->glstate.calls = 0;
+
+  //draw requests are coalesced by the gl loop, one more draw
+  //for the frames still queued
+  if (g_atomic_int_get (&display->ring_head) !=
+      g_atomic_int_get (&display->ring_tail))
+    gst_gl_window_draw_unlocked (display->gl_window,
+        display->window_width, display->window_height);
+
   g_signal_emit (display, display_signals[DRAW_FINISH_SIGNAL], 0);
 }
 
+/* Called by the gl loop every half idle_timeout, drawing or not */
+void
+gst_gl_display_on_timeout (GstGLDisplay * display)
+{
+  g_mutex_lock(display->texlock);
+  gst_gl_display_pool_expire(display);
+  g_mutex_unlock(display->texlock);
+}
+
 void
 gst_gl_display_on_close (GstGLDisplay * display)
 {
@@ -703,98 +1255,288 @@ gst_gl_display_on_close (GstGLDisplay * display)
   GST_INFO("on_close finish");
 }
 
+static guint
+gst_gl_display_program_hash (gconstpointer key)
+{
+  const GstGLDisplayProgram *program = key;
+  return (guint)program->format * 31 + program->variant;
+}
+
 static gboolean
-caps_match(GstEGLBuffer *buf, GstEGLTexture *info)
+gst_gl_display_program_equal (gconstpointer a, gconstpointer b)
 {
-  return buf->format == info->format &&
-         buf->width == info->width &&
-         buf->height == info->height;
+  const GstGLDisplayProgram *pa = a;
+  const GstGLDisplayProgram *pb = b;
+  return pa->format == pb->format && pa->variant == pb->variant;
 }
 
+/* Called in the gl thread */
 static void
-assign_texture(GstEGLBuffer *buf, GstEGLTexture *info)
+gst_gl_display_program_free (gpointer data)
 {
-  buf->texinfo = info;
+  GstGLDisplayProgram *program = data;
+  g_object_unref (G_OBJECT (program->shader));
+  g_slice_free(GstGLDisplayProgram, program);
+}
+
+static guint
+gst_gl_display_tex_bucket_hash (gconstpointer key)
+{
+  const GstGLDisplayTexBucket *bucket = key;
+  return ((guint)bucket->format * 31 + (guint)bucket->width) * 31 +
+      (guint)bucket->height;
 }
 
 static gboolean
-reuse_texture(GstEGLBuffer *buf, GstEGLTexture *info)
+gst_gl_display_tex_bucket_equal (gconstpointer a, gconstpointer b)
+{
+  const GstGLDisplayTexBucket *ba = a;
+  const GstGLDisplayTexBucket *bb = b;
+  return ba->format == bb->format &&
+         ba->width == bb->width &&
+         ba->height == bb->height;
+}
+
+static void
+gst_gl_display_tex_bucket_free (gpointer data)
+{
+  GstGLDisplayTexBucket *bucket = data;
+  g_queue_clear(&bucket->textures);
+  g_slice_free(GstGLDisplayTexBucket, bucket);
+}
+
+/* Called with texlock held. Empty buckets are dropped so that free_lru
+ * only ever holds buckets with idle textures in it */
+static GstEGLTexture *
+gst_gl_display_bucket_pop (GstGLDisplay * display, GstGLDisplayTexBucket * bucket,
+    gboolean oldest)
+{
+  GstEGLTexture *info = oldest ? g_queue_pop_head(&bucket->textures) :
+      g_queue_pop_tail(&bucket->textures);
+  display->free_count--;
+  if(g_queue_is_empty(&bucket->textures))
+  {
+    g_queue_unlink(&display->free_lru, &bucket->lru_link);
+    g_hash_table_remove(display->free_textures, bucket);
+  }
+  return info;
+}
+
+/* Take the most recently released texture with the given geometry, if any
+ * Called with texlock held */
+static GstEGLTexture *
+gst_gl_display_pool_pop (GstGLDisplay * display, GstVideoFormat format,
+    gint width, gint height)
 {
-  if(caps_match(buf, info))
+  GstGLDisplayTexBucket key;
+  GstGLDisplayTexBucket *bucket;
+
+  key.format = format;
+  key.width = width;
+  key.height = height;
+  bucket = g_hash_table_lookup(display->free_textures, &key);
+  if(!bucket)
+    return NULL;
+
+  return gst_gl_display_bucket_pop(display, bucket, FALSE);
+}
+
+/* Take the oldest texture of the least recently used geometry, if any
+ * Called with texlock held */
+static GstEGLTexture *
+gst_gl_display_pool_pop_lru (GstGLDisplay * display)
+{
+  GList *link = g_queue_peek_head_link(&display->free_lru);
+
+  if(!link)
+    return NULL;
+
+  return gst_gl_display_bucket_pop(display, link->data, TRUE);
+}
+
+/* Give a texture back to the pool and mark its geometry as most recently used
+ * Called with texlock held */
+static void
+gst_gl_display_pool_push (GstGLDisplay * display, GstEGLTexture * info)
+{
+  GstGLDisplayTexBucket key;
+  GstGLDisplayTexBucket *bucket;
+
+  key.format = info->format;
+  key.width = info->width;
+  key.height = info->height;
+  bucket = g_hash_table_lookup(display->free_textures, &key);
+  if(!bucket)
   {
-    assign_texture(buf, info);
-    return TRUE;
+    bucket = g_slice_new0(GstGLDisplayTexBucket);
+    bucket->format = info->format;
+    bucket->width = info->width;
+    bucket->height = info->height;
+    g_queue_init(&bucket->textures);
+    bucket->lru_link.data = bucket;
+    g_hash_table_insert(display->free_textures, bucket, bucket);
   }
   else
-    return FALSE;
+    g_queue_unlink(&display->free_lru, &bucket->lru_link);
+
+  info->last_used = gst_util_get_timestamp();
+  g_queue_push_tail(&bucket->textures, info);
+  g_queue_push_tail_link(&display->free_lru, &bucket->lru_link);
+  display->free_count++;
+}
+
+/* Has the gl loop look for idle textures every half idle_timeout, so
+ * that they are freed at most 1.5 idle_timeout after their last use
+ * Called with texlock held */
+static void
+gst_gl_display_start_expire_timer (GstGLDisplay * display, GstGLWindow * window)
+{
+  GstClockTime interval = 0;
+
+  if(display->idle_timeout)
+    interval = MAX(display->idle_timeout / 2, GST_MSECOND);
+  gst_gl_window_set_timeout_callback (window,
+      GST_GL_WINDOW_CB (gst_gl_display_on_timeout), display, interval);
+}
+
+/* Free the idle textures that have not been used for idle_timeout
+ * Called in the gl thread with texlock held */
+static void
+gst_gl_display_pool_expire (GstGLDisplay * display)
+{
+  GstClockTime now;
+  GList *link, *next;
+
+  if(!display->idle_timeout || !display->free_count)
+    return;
+
+  now = gst_util_get_timestamp();
+  for(link = g_queue_peek_head_link(&display->free_lru); link; link = next)
+  {
+    GstGLDisplayTexBucket *bucket = link->data;
+    GstEGLTexture *info;
+    gboolean last;
+    next = link->next;
+    while((info = g_queue_peek_head(&bucket->textures)) &&
+        now - info->last_used >= display->idle_timeout)
+    {
+      //the bucket is freed with its last texture, don't look at it again
+      last = bucket->textures.length == 1;
+      GST_INFO("====== expire texture %d [%d, %d]", info->texture, info->width, info->height);
+      gst_gl_display_gldel_texture(gst_gl_display_bucket_pop(display, bucket, TRUE), display);
+      if(last)
+        break;
+    }
+  }
 }
 
-/* Generate a texture if no one is available in the pool
+/* Whether an image of size bytes fits in the pool limits, which is either
+ * the max_pool_bytes budget or GST_GL_DISPLAY_MAX_BUFFER_COUNT images.
+ * A single image is always allowed so that an undersized budget can't stall
+ * Called with texlock held */
+static gboolean
+gst_gl_display_pool_has_room (GstGLDisplay * display, gsize size)
+{
+  if(display->max_pool_bytes)
+    return display->alloc_count == 0 ||
+        display->pool_bytes + size <= display->max_pool_bytes;
+  return display->alloc_count < GST_GL_DISPLAY_MAX_BUFFER_COUNT;
+}
+
+static void
+assign_texture(GstEGLBuffer *buf, GstEGLTexture *info)
+{
+  buf->texinfo = info;
+}
+
+/* Create an EGLImage backed texture, called with texlock held
  * Called in the gl thread */
-void
-gst_gl_display_glgen_texture (GstEGLBuffer *buffer)
+GstEGLTexture *
+gst_gl_display_glnew_texture (GstGLDisplay * display, GstVideoFormat format,
+    gint width, gint height)
 {
   GLenum target;
-  GList *first;
+  GstEGLTexture *info = g_slice_new0(GstEGLTexture);
+  info->format = format;
+  info->width = width;
+  info->height = height;
+  target = gst_egl_platform_get_target(format);
+  gst_egl_platform_alloc_image(gst_gl_window_get_egl_display(display->gl_window), info);
+  if(!info->image)
+  {
+    g_slice_free(GstEGLTexture, info);
+    GST_ERROR("gst_egl_platform_alloc_image failed: out of memory");
+    return NULL;
+  }
+
+  GL_CALL (display, glGenTextures (1, &info->texture));
+
+  gst_gl_display_glstate_enable_target(display, target);
+  gst_gl_display_glstate_bind_texture(display, target, info->texture);
+  GL_CALL (display, glTexParameteri (target, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CALL (display, glTexParameteri (target, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+  GL_CALL (display, glEGLImageTargetTexture2DOES (target, info->image));
+
+  display->alloc_count++;
+  display->pool_bytes += info->size;
+  display->stat_bytes_allocated += info->size;
+  if(display->alloc_count > display->stat_peak_alloc)
+    display->stat_peak_alloc = display->alloc_count;
+  GST_INFO("===== create texture %d, target %d, %" G_GSIZE_FORMAT " bytes, pool %"
+      G_GUINT64_FORMAT " bytes", info->texture, target, info->size, display->pool_bytes);
+  return info;
+}
+
+/* Reuse or create a texture for the buffer without ever waiting, the
+ * caller waits for a release in gst_gl_display_gen_texture when the pool is
+ * full. Returns FALSE only if the image allocation itself failed.
+ * Called in the gl thread */
+gboolean
+gst_gl_display_glgen_texture (GstEGLBuffer *buffer)
+{
   GstEGLTexture *info;
   GstGLDisplay *display = buffer->display;
+  gboolean ret = TRUE;
+  gsize size = gst_egl_platform_get_image_size(buffer->format,
+      buffer->width, buffer->height);
   
   g_mutex_lock(display->texlock);
-  while(!buffer->texinfo)
+  if(!buffer->texinfo)
   {
-    while(display->free_textures)
+    info = gst_gl_display_pool_pop(display, buffer->format, buffer->width, buffer->height);
+    if(info)
     {
-      first = g_list_first(display->free_textures);
-      info = (GstEGLTexture*)(first->data);
-      display->free_textures = g_list_remove_link(display->free_textures, first);
-      g_list_free(first);
-      if(!reuse_texture(buffer, info))  //cannot reuse
-        gst_gl_display_gldel_texture(info, display);
-      else
-      {
-        GST_INFO("====== reuse texture %d", info->texture);
-        break;
-      }
+      assign_texture(buffer, info);
+      display->stat_hits++;
+      GST_INFO("====== reuse texture %d", info->texture);
+      goto done;
     }
-    if(!buffer->texinfo && display->alloc_count < GST_GL_DISPLAY_MAX_BUFFER_COUNT)
+    //make room by dropping idle textures, which are all of other geometries
+    //at this point, least recently used first
+    while(!gst_gl_display_pool_has_room(display, size) &&
+        (info = gst_gl_display_pool_pop_lru(display)))
     {
-      info = g_slice_new0(GstEGLTexture);
-      info->format = buffer->format;
-      info->width = buffer->width;
-      info->height = buffer->height;
-      target = gst_egl_platform_get_target(buffer->format);
-      gst_egl_platform_alloc_image(gst_gl_window_get_egl_display(display->gl_window), info);
-      if(info->image)
+      GST_INFO("====== evict texture %d [%d, %d]", info->texture, info->width, info->height);
+      gst_gl_display_gldel_texture(info, display);
+      display->stat_mismatch_deletes++;
+    }
+    if(gst_gl_display_pool_has_room(display, size))
+    {
+      info = gst_gl_display_glnew_texture(display, buffer->format,
+          buffer->width, buffer->height);
+      if(info)
       {
-        glGenTextures(1, &info->texture);
-  
-        glEnable(target);
-        glBindTexture(target, info->texture);
-        glTexParameteri (target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri (target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glEGLImageTargetTexture2DOES(target, info->image);
-        glBindTexture (target, 0);
-        glDisable(target);
-
         assign_texture(buffer, info);
-    
-        display->alloc_count++;
-        GST_INFO("===== create texture %d for buffer %p, target %d", info->texture, buffer, target);
+        display->stat_misses++;
+        GST_INFO("===== create texture %d for buffer %p", info->texture, buffer);
       }
       else
-      {
-        g_slice_free(GstEGLTexture, info);
-        GST_ERROR("gst_egl_platform_alloc_image failed: out of memory");
-      }
-      break;
-    }
-    else if(!buffer->texinfo)
-    {
-      GST_INFO("###### wait for texture release");
-      g_cond_wait(display->cond_tex, display->texlock);
+        ret = FALSE;
     }
   }
+done:
   g_mutex_unlock(display->texlock);
+  return ret;
 }
 
 
@@ -806,11 +1548,15 @@ gst_gl_display_gldel_texture (gpointer data, gpointer user_data)
   GstEGLTexture *info = (GstEGLTexture *)data;
   GstGLDisplay *display = GST_GL_DISPLAY(user_data);
   GST_INFO ("deleted texture id:%d", info->texture);
-  glDeleteTextures (1, &info->texture);
+  GL_CALL (display, glDeleteTextures (1, &info->texture));
+  //deleting the bound texture makes gl bind 0
+  if (display->glstate.texture == info->texture)
+    display->glstate.texture = 0;
   gst_egl_platform_free_image(gst_gl_window_get_egl_display(display->gl_window), info);
-  g_slice_free(GstEGLTexture, info);
   display->alloc_count--;
+  display->pool_bytes -= info->size;
   GST_INFO ("deleted texture id:%d done", info->texture);
+  g_slice_free(GstEGLTexture, info);
 }
 
 //------------------------------------------------------------
@@ -862,17 +1608,17 @@ gst_gl_display_destroy_context(GstGLDisplay * display)
   GST_INFO("begin");
   gst_gl_display_lock(display);
   display->isAlive = FALSE;
-  //unref all reffered buffers, thus no one reffered this display
-  if (display->todraw) {
-    gst_egl_buffer_unref(display->todraw);
-    display->todraw = NULL;
-  }
-  if (display->drawing) {
-    gst_egl_buffer_unref(display->drawing);
-    display->drawing = NULL;
-  }
-  g_cond_signal(display->cond_disp);
+  g_cond_broadcast(display->cond_disp);
   gst_gl_display_unlock (display);
+  //unref all reffered buffers, thus no one reffered this display. The frames
+  //belong to the gl thread, only release them here once its loop is gone
+  if (!gst_gl_window_send_message (display->gl_window,
+          GST_GL_WINDOW_CB (gst_gl_display_thread_release_frames), display))
+    gst_gl_display_thread_release_frames (display);
+  //wake up allocations waiting for a texture release
+  g_mutex_lock (display->texlock);
+  g_cond_broadcast (display->cond_tex);
+  g_mutex_unlock (display->texlock);
   GST_INFO("end");
 }
 
@@ -881,58 +1627,191 @@ gboolean
 gst_gl_display_redisplay (GstGLDisplay * display, GstEGLBuffer *buffer,
     gint window_width, gint window_height, gboolean keep_aspect_ratio)
 {
-  gboolean isAlive = TRUE;
-
   GST_INFO("------ redisplay buffer %p", buffer);
-  gst_gl_display_lock (display);
-  isAlive = display->isAlive;
-  if (isAlive) {
-    if (!display->redisplay_shader) {
-      gst_gl_display_unlock (display);
+  if (!display->isAlive)
+    return FALSE;
+
+  if (buffer && !gst_gl_display_push_frame (display, buffer))
+    return FALSE;
+
+  if (g_atomic_int_get (&display->keep_aspect_ratio) != keep_aspect_ratio) {
+    //slow path, the viewport is recomputed in the gl thread
+    gst_gl_display_lock (display);
+    g_atomic_int_set (&display->keep_aspect_ratio, keep_aspect_ratio);
+    display->window_width = window_width;
+    display->window_height = window_height;
+    gst_gl_display_unlock (display);
+    gst_gl_window_send_message (display->gl_window,
+        GST_GL_WINDOW_CB (gst_gl_display_thread_on_resize), display);
+  }
+  if (display->gl_window)
+    gst_gl_window_draw (display->gl_window, window_width, window_height);
+  GST_INFO("------ redisplay buffer %p done", buffer);
+
+  return display->isAlive;
+}
+
+/* Called by gst_gl_buffer_new, not in the gl thread.
+ * Waiting for a texture to be released happens here so that the gl thread
+ * keeps drawing, which is what eventually releases textures. Without wait
+ * a full pool is reported right away and not counted as a fallback, the
+ * caller already waited for this frame */
+GstGLDisplayAllocResult
+gst_gl_display_gen_texture (GstGLDisplay * display, GstEGLBuffer *buffer,
+    gboolean wait)
+{
+  GstGLDisplayGenTexture gen;
+  GstGLDisplayAllocResult result = GST_GL_DISPLAY_ALLOC_FAILED;
+  gint timeout = g_atomic_int_get (&display->alloc_timeout);
+  GTimeVal deadline;
+  GstClockTime start;
+  gboolean released = TRUE;
+  gsize size = gst_egl_platform_get_image_size(buffer->format,
+      buffer->width, buffer->height);
+
+  if (timeout > 0) {
+    g_get_current_time (&deadline);
+    g_time_val_add (&deadline, (glong) timeout * 1000);
+  }
+
+  gen.buffer = buffer;
+  g_mutex_lock (display->texlock);
+  while (!buffer->texinfo && display->isAlive) {
+    //fast path, no gl call needed to hand out an idle texture
+    GstEGLTexture *info = gst_gl_display_pool_pop (display, buffer->format,
+        buffer->width, buffer->height);
+    if (info) {
+      assign_texture (buffer, info);
+      display->stat_hits++;
+      GST_INFO ("====== reuse texture %d", info->texture);
+      break;
+    }
+
+    if (display->free_count > 0 || gst_gl_display_pool_has_room (display, size)) {
+      gen.failed = FALSE;
+      g_mutex_unlock (display->texlock);
       gst_gl_window_send_message (display->gl_window,
-          GST_GL_WINDOW_CB (gst_gl_display_thread_init_redisplay), display);
-      gst_gl_display_lock (display);
+          GST_GL_WINDOW_CB (gst_gl_display_thread_gen_texture), &gen);
+      g_mutex_lock (display->texlock);
+      if (buffer->texinfo || gen.failed)
+        break;
+      //another buffer took the room meanwhile
+      continue;
     }
-    while(isAlive && buffer && display->todraw) {	//wait last buffer display finish
-      GST_INFO("###### wait for display finish");
-      g_cond_wait(display->cond_disp, display->mutex);
-      isAlive = display->isAlive;
+
+    GST_INFO ("###### wait for texture release");
+    result = GST_GL_DISPLAY_ALLOC_TIMEOUT;
+    if (!wait)
+      break;
+    if (timeout == 0) {
+      display->alloc_fallbacks++;
+      GST_WARNING_OBJECT (display, "no texture available, not waiting");
+      break;
     }
-    if(isAlive && (!buffer || buffer != display->drawing))
-    {
-      if(buffer)
-        display->todraw = gst_egl_buffer_ref(buffer);
-      if(display->keep_aspect_ratio != keep_aspect_ratio)
-      {
-        display->keep_aspect_ratio = keep_aspect_ratio;
-        display->window_width = window_width;
-        display->window_height = window_height;
-        gst_gl_display_unlock (display);
-        gst_gl_window_send_message (display->gl_window,
-            GST_GL_WINDOW_CB (gst_gl_display_thread_on_resize), display);
-        gst_gl_display_lock (display);
-      }
-      if (display->gl_window) {
-        gst_gl_display_unlock (display);
-        gst_gl_window_draw (display->gl_window, window_width, window_height);
-        gst_gl_display_lock(display);
-      }
+    start = gst_util_get_timestamp ();
+    if (timeout < 0)
+      g_cond_wait (display->cond_tex, display->texlock);
+    else
+      released = g_cond_timed_wait (display->cond_tex, display->texlock,
+          &deadline);
+    display->stat_waits++;
+    display->stat_wait_time += gst_util_get_timestamp () - start;
+    if (!released) {
+      display->alloc_fallbacks++;
+      GST_WARNING_OBJECT (display, "no texture released within %d ms",
+          timeout);
+      break;
     }
+    //released, try again
+    result = GST_GL_DISPLAY_ALLOC_FAILED;
   }
-  gst_gl_display_unlock (display);
-  GST_INFO("------ redisplay buffer %p done", buffer);
+  if (buffer->texinfo)
+    result = GST_GL_DISPLAY_ALLOC_OK;
+  g_mutex_unlock (display->texlock);
 
-  return isAlive;
+  return result;
 }
 
-/* Called by gst_gl_buffer_new */
+/* Called by the glimagesink when caps are set, so that the first frames
+ * after a caps change find their textures ready in the pool */
 void
-gst_gl_display_gen_texture (GstGLDisplay * display, GstEGLBuffer *buffer)
+gst_gl_display_prealloc_textures (GstGLDisplay * display, GstCaps * caps,
+    gint count)
 {
-  if (display->isAlive) {
+  GstGLDisplayPrealloc prealloc;
+  gint right = 0, bottom = 0;
+
+  if (!display->isAlive || count <= 0)
+    return;
+  if (!gst_video_format_parse_caps (caps, &prealloc.format, &prealloc.width,
+          &prealloc.height))
+    return;
+  align_buffer_size (prealloc.format, &prealloc.width, &prealloc.height,
+      &right, &bottom);
+
+  prealloc.display = display;
+  prealloc.count = count;
+  gst_gl_window_send_message (display->gl_window,
+      GST_GL_WINDOW_CB (gst_gl_display_thread_prealloc_textures), &prealloc);
+}
+
+/* Snapshot of the texture pool counters, the caller owns the structure.
+ * Called by the glimagesink for its stats property */
+GstStructure *
+gst_gl_display_get_stats (GstGLDisplay * display)
+{
+  GstStructure *stats;
+
+  g_mutex_lock (display->texlock);
+  stats = gst_structure_new ("GstGLDisplayStats",
+      "hits", G_TYPE_UINT64, display->stat_hits,
+      "misses", G_TYPE_UINT64, display->stat_misses,
+      "mismatched-deletions", G_TYPE_UINT64, display->stat_mismatch_deletes,
+      "waits", G_TYPE_UINT64, display->stat_waits,
+      "wait-time", G_TYPE_UINT64, display->stat_wait_time,
+      "peak-alloc-count", G_TYPE_INT, display->stat_peak_alloc,
+      "bytes-allocated", G_TYPE_UINT64, display->stat_bytes_allocated,
+      "upload-bulk-planes", G_TYPE_UINT64, display->stat_bulk_planes,
+      "upload-row-planes", G_TYPE_UINT64, display->stat_row_planes,
+      "upload-kernels", G_TYPE_STRING, display->upload_kernels,
+      "alloc-count", G_TYPE_INT, display->alloc_count,
+      "free-count", G_TYPE_INT, display->free_count,
+      "pool-bytes", G_TYPE_UINT64, display->pool_bytes,
+      "fallbacks", G_TYPE_INT, display->alloc_fallbacks,
+      NULL);
+  g_mutex_unlock (display->texlock);
+
+  gst_structure_set (stats, "frames-dropped", G_TYPE_UINT64,
+      (guint64) (guint) g_atomic_int_get (&display->frames_dropped),
+      "gl-calls-per-frame", G_TYPE_UINT,
+      (guint) g_atomic_int_get (&display->glstate.calls_last_frame), NULL);
+
+  gst_gl_window_add_stats (display->gl_window, stats);
+
+  return stats;
+}
+
+/* Free every idle texture of the pool, the textures held by buffers are
+ * left alone. Called by the glimagesink trim-pool action */
+void
+gst_gl_display_trim_pool (GstGLDisplay * display)
+{
+  if (display->isAlive)
     gst_gl_window_send_message (display->gl_window,
-        GST_GL_WINDOW_CB (gst_gl_display_thread_gen_texture), buffer);
-  }
+        GST_GL_WINDOW_CB (gst_gl_display_thread_del_textures), display);
+}
+
+/* Idle textures older than timeout are freed by the gl loop, whether
+ * frames are drawn or not. 0 keeps them. Called by the glimagesink */
+void
+gst_gl_display_set_idle_timeout (GstGLDisplay * display, GstClockTime timeout)
+{
+  g_mutex_lock (display->texlock);
+  display->idle_timeout = timeout;
+  //create_context starts the timer itself if there is no window yet
+  if (display->gl_window)
+    gst_gl_display_start_expire_timer (display, display->gl_window);
+  g_mutex_unlock (display->texlock);
 }
 
 /* Called by gst_gl_buffer_finalize */
@@ -942,8 +1821,8 @@ gst_gl_display_del_texture (GstGLDisplay * display, GstEGLBuffer *buffer)
   GST_INFO("Delete texture of buffer %p", buffer);
   if (buffer->texinfo) {
     g_mutex_lock (display->texlock);
-    display->free_textures = g_list_append(display->free_textures, buffer->texinfo);
-    g_cond_signal(display->cond_tex);
+    gst_gl_display_pool_push(display, buffer->texinfo);
+    g_cond_broadcast(display->cond_tex);
     g_mutex_unlock (display->texlock);
     buffer->texinfo = NULL;
   }
@@ -964,6 +1843,31 @@ gst_gl_display_do_upload (GstGLDisplay * display, GstEGLBuffer *buffer, GstBuffe
   return isAlive;
 }
 
+/* Same as gst_gl_display_do_upload but does not wait for the upload,
+ * the returned fence (NULL if there is nothing to wait for) tells when
+ * src is no longer read. A frame redisplayed afterwards is only drawn
+ * once its upload is done */
+GstGLWindowFence *
+gst_gl_display_do_upload_async (GstGLDisplay * display, GstEGLBuffer *buffer,
+    GstBuffer *src)
+{
+  GstGLWindowFence *fence = NULL;
+  g_return_val_if_fail(buffer && src, NULL);
+  if (display->isAlive) {
+    gst_egl_buffer_attach(buffer, src);
+    fence = gst_gl_window_submit_message (display->gl_window,
+        GST_GL_WINDOW_CB (gst_gl_display_thread_do_upload_async),
+        gst_buffer_ref (GST_BUFFER (buffer)));
+    //the gl loop is gone, the job will never drop its ref
+    if (!fence) {
+      gst_egl_buffer_attach(buffer, NULL);
+      gst_egl_buffer_unref (buffer);
+    }
+  }
+
+  return fence;
+}
+
 /* Called by the glimagesink */
 void
 gst_gl_display_set_window_id (GstGLDisplay * display, gulong window_id)
@@ -997,6 +1901,44 @@ gst_gl_display_activate_gl_context (GstGLDisplay * display, gboolean activate)
 //------------------------ END PUBLIC ------------------------
 //------------------------------------------------------------
 
+/* Called in the gl thread
+ * The image memory is usually uncached or write-combined. Streaming stores
+ * beat memcpy on every frame that does not stay in the caches, see
+ * tests/benchmarks/eglconvert-copy */
+static const GstEGLConvertKernels *
+gst_gl_display_get_copy_kernels (GstGLDisplay * display)
+{
+  const GstEGLConvertKernels *streaming =
+      gst_egl_convert_get_streaming_kernels ();
+
+  if (streaming && g_atomic_int_get (&display->upload_copy) ==
+      GST_GL_DISPLAY_UPLOAD_COPY_STREAMING)
+    return streaming;
+  return gst_egl_convert_get_kernels ();
+}
+
+/* The part of the frame an upload has to write: the visible rectangle
+ * plus one texel around it, read by the linear sampler at the edges */
+static void
+gst_gl_display_get_upload_rect (GstEGLBuffer * buffer, GstEGLRect * rect)
+{
+  gint left = CLAMP (buffer->crop_left - 1, 0, buffer->width);
+  gint top = CLAMP (buffer->crop_top - 1, 0, buffer->height);
+  gint right = CLAMP (buffer->width - buffer->crop_right + 1, 0, buffer->width);
+  gint bottom =
+      CLAMP (buffer->height - buffer->crop_bottom + 1, 0, buffer->height);
+
+  if (right <= left || bottom <= top) {
+    left = top = 0;
+    right = buffer->width;
+    bottom = buffer->height;
+  }
+  rect->x = left;
+  rect->y = top;
+  rect->width = right - left;
+  rect->height = bottom - top;
+}
+
 /* called by gst_gl_display_thread_do_upload (in the gl thread) */
 void
 gst_gl_display_thread_do_upload_fill (GstEGLBuffer * buffer)
@@ -1004,27 +1946,59 @@ gst_gl_display_thread_do_upload_fill (GstEGLBuffer * buffer)
   GstBuffer *src = buffer->attach;
   gint width = buffer->width;
   gint height = buffer->height;
-  gpointer data = GST_BUFFER_DATA(src);
-  GST_INFO("==========do_upload_fill %p, width %d, height %d", buffer, width, height);
+  gpointer data;
+  GstEGLRect rect;
+  //already done by gst_gl_display_on_draw
+  if (!src)
+    return;
+  data = GST_BUFFER_DATA(src);
+  gst_gl_display_get_upload_rect (buffer, &rect);
+  GST_INFO("==========do_upload_fill %p, width %d, height %d, rect [%d, %d, %d, %d]",
+      buffer, width, height, rect.x, rect.y, rect.width, rect.height);
   if(buffer->format == buffer->texinfo->real_format)
   {
+    GstGLDisplay *display = buffer->display;
     GLenum target = gst_egl_platform_get_target(buffer->format);
     GLenum internalformat, format, type;
-    glEnable(target);
-    glBindTexture (target, buffer->texinfo->texture);
+    gint y = 0;
+    gst_gl_display_glstate_enable_target (display, target);
+    gst_gl_display_glstate_bind_texture (display, target, buffer->texinfo->texture);
 
     gst_egl_platform_get_format_info(buffer->format, &internalformat, &format, &type);
-    glTexSubImage2D (target, 0, 0, 0, width, height, format, type, data);
-
-    //make sure no texture is in use in our opengl context
-    //in case we want to use the upload texture in an other opengl context
-    glBindTexture (target, 0);
-    glDisable(target);
+    //GLES2 has no GL_UNPACK_ROW_LENGTH, so only whole rows of the packed
+    //rgb formats can be skipped, planar yuv is always uploaded whole
+    if (buffer->format == GST_VIDEO_FORMAT_RGBA ||
+        buffer->format == GST_VIDEO_FORMAT_BGRA) {
+      y = rect.y;
+      height = rect.height;
+    }
+    GL_CALL (display, glTexSubImage2D (target, 0, 0, y, width, height, format,
+            type, (guint8 *) data + (gsize) y * width * 4));
   }
   else
   {
+    GstGLDisplay *display = buffer->display;
+    gint threads = g_atomic_int_get (&display->upload_threads);
+    guint bulk_planes, row_planes;
+    const GstEGLConvertKernels *kernels;
+    //follow upload-threads changes, the workers are kept between frames
+    if (!display->convert_pool || display->convert_pool_threads != threads) {
+      if (display->convert_pool)
+        gst_egl_convert_pool_free (display->convert_pool);
+      display->convert_pool = gst_egl_convert_pool_new (threads);
+      display->convert_pool_threads = threads;
+    }
+    kernels = gst_gl_display_get_copy_kernels (display);
     gst_egl_platform_convert_color_space(data, buffer->format, GST_BUFFER_DATA(buffer),
-			buffer->texinfo->real_format, width, height, buffer->texinfo->stride);
+			buffer->texinfo->real_format, width, height, buffer->texinfo->stride,
+			&rect, kernels, display->convert_pool);
+
+    gst_egl_convert_pool_pop_stats (display->convert_pool, &bulk_planes, &row_planes);
+    g_mutex_lock (display->texlock);
+    display->stat_bulk_planes += bulk_planes;
+    display->stat_row_planes += row_planes;
+    display->upload_kernels = kernels->name;
+    g_mutex_unlock (display->texlock);
   }
   gst_egl_buffer_attach(buffer, NULL);
 }
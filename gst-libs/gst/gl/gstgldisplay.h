@@ -26,6 +26,7 @@
 #include <gst/video/video.h>
 
 #include "gstegltypes.h"
+#include "gsteglconvert.h"
 #include "gstglwindow.h"
 #include "gstglshader.h"
 
@@ -43,8 +44,52 @@ G_BEGIN_DECLS
   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_GL_DISPLAY))
 
 #define GST_GL_DISPLAY_MAX_BUFFER_COUNT		(32)
+#define GST_GL_DISPLAY_MAX_QUEUED_FRAMES	(16)
 
 typedef struct _GstGLDisplayClass GstGLDisplayClass;
+typedef struct _GstGLDisplayTexBucket GstGLDisplayTexBucket;
+typedef struct _GstGLDisplayProgram GstGLDisplayProgram;
+
+/* What gst_gl_display_redisplay does when the frame queue is full */
+typedef enum
+{
+  GST_GL_DISPLAY_PRESENT_FIFO,      //wait for a queued frame to be shown
+  GST_GL_DISPLAY_PRESENT_MAILBOX    //drop the oldest queued frame, never wait
+} GstGLDisplayPresentMode;
+
+/* Outcome of a texture allocation for a buffer */
+typedef enum
+{
+  GST_GL_DISPLAY_ALLOC_OK,
+  GST_GL_DISPLAY_ALLOC_FAILED,      //the image could not be created, or the display is gone
+  GST_GL_DISPLAY_ALLOC_TIMEOUT      //the pool stayed full, see alloc_timeout
+} GstGLDisplayAllocResult;
+
+/* How software uploads write the image memory */
+typedef enum
+{
+  GST_GL_DISPLAY_UPLOAD_COPY_CACHED,    //regular stores (memcpy)
+  GST_GL_DISPLAY_UPLOAD_COPY_STREAMING  //full line streaming stores, cached if the cpu has none
+} GstGLDisplayUploadCopy;
+
+/* Last state set on the gl context, so that only real transitions reach
+ * the driver. G_MAXUINT means unknown. Only used in the gl thread */
+typedef struct _GstGLDisplayGLState
+{
+  gboolean program_known;
+  GstGLShader *program;
+  GLenum enabled_target;
+  GLenum active_texture;
+  GLenum texture_target;
+  GLuint texture;
+  GLuint array_buffer;
+  GLuint element_buffer;
+  guint32 attribs_known;      //one bit per vertex attrib location
+  guint32 attribs_enabled;
+  GLuint quad_pointers;       //vbo the quad attrib pointers were set for
+  guint calls;                //gl calls issued since the last frame
+  volatile gint calls_last_frame;  //read by get_stats, atomic
+} GstGLDisplayGLState;
 
 typedef void (*GstGLDisplayThreadFunc) (GstGLDisplay * display, gpointer data);
 
@@ -66,21 +111,65 @@ struct _GstGLDisplay
 
   //buffer management
   gint  alloc_count;
-  GList *free_textures;
+  GHashTable *free_textures;  //(format, width, height) -> GstGLDisplayTexBucket
+  GQueue free_lru;            //non-empty buckets, least recently used first
+  gint  free_count;
+  guint64 pool_bytes;         //bytes of all allocated images
+  guint64 max_pool_bytes;     //0 means limited to GST_GL_DISPLAY_MAX_BUFFER_COUNT
+  volatile gint alloc_timeout;  //ms to wait for a texture release, -1 forever, atomic
+  gint  alloc_fallbacks;      //allocations given up after alloc_timeout
+  GstClockTime idle_timeout;  //idle textures older than this are freed, 0 never, set with gst_gl_display_set_idle_timeout
+  //texture pool statistics, protected by texlock
+  guint64 stat_hits;          //textures reused from the pool
+  guint64 stat_misses;        //images created on demand
+  guint64 stat_mismatch_deletes;  //idle textures deleted to make room for another geometry
+  guint64 stat_waits;         //waits on cond_tex
+  GstClockTime stat_wait_time;    //cumulative time spent waiting on cond_tex
+  gint  stat_peak_alloc;      //highest alloc_count
+  guint64 stat_bytes_allocated;   //cumulative bytes of created images
+  guint64 stat_bulk_planes;   //software uploaded planes copied as one block
+  guint64 stat_row_planes;    //software uploaded planes copied row by row
   GMutex *texlock;
   GCond *cond_tex;
   GCond *cond_disp;
-  GstEGLBuffer *todraw;
-  GstEGLBuffer *drawing;
-
-  //action redisplay
-  gboolean keep_aspect_ratio;
+  //frame handoff, a single producer (redisplay) single consumer (on_draw)
+  //ring of frames waiting to be drawn. display->mutex and cond_disp are only
+  //used by a fifo producer waiting for room
+  volatile gpointer ring[GST_GL_DISPLAY_MAX_QUEUED_FRAMES];  //GstEGLBuffer refs
+  volatile gint ring_head;    //oldest frame, moved forward with a CAS
+  volatile gint ring_tail;    //next free slot, written by the producer only
+  volatile gint frame_waiters;
+  volatile gint max_queued_frames;  //atomic
+  GstEGLBuffer *presenting;   //gl thread only, popped by on_draw, on screen after the swap
+  GstEGLBuffer *drawing;      //gl thread only, on screen
+  volatile gint present_mode;  //GstGLDisplayPresentMode, atomic
+  volatile gint frames_dropped;  //queued frames dropped in mailbox mode, atomic
+
+  //software upload
+  volatile gint upload_threads;  //conversion threads, 0 one per cpu, atomic
+  GstEGLConvertPool *convert_pool;  //gl thread only, made for convert_pool_threads
+  gint  convert_pool_threads;
+  volatile gint upload_copy;  //GstGLDisplayUploadCopy, atomic
+  const gchar *upload_kernels;  //last used by a software upload, protected by texlock
+
+  //action redisplay, the geometry is the one of the last drawn buffer
+  //and is only updated in the gl thread
+  volatile gint keep_aspect_ratio;  //atomic, changed under display->mutex
   GstVideoFormat redisplay_format;
-  GstGLShader *redisplay_shader;
+  GstGLShader *redisplay_shader;  //owned by shader_cache
+  GHashTable *shader_cache;   //(format, variant) -> GstGLDisplayProgram, gl thread only
+  gchar *shader_cache_dir;    //on-disk program binary cache, NULL disabled
   GLint redisplay_attr_position_loc;
   GLint redisplay_attr_texture_loc;
+  GstGLShaderUniform *redisplay_texture_uniform;
+  GLuint redisplay_vbo;       //quad vertices, rewritten when the sampler changes
+  GLuint redisplay_ibo;       //quad indices
+  gboolean redisplay_vbo_dirty;
+  GstGLDisplayGLState glstate;
   gint  window_width;
   gint  window_height;
+  gint  surface_width;        //last size given to on_resize
+  gint  surface_height;
   gint  tex_width;
   gint  tex_height;
   gint  crop_left;
@@ -91,8 +180,6 @@ struct _GstGLDisplay
   gfloat sampler_right;
   gfloat sampler_top;
   gfloat sampler_bottom;
-  gchar *vertex_src;
-  gchar *fragment_src;
 
   //foreign gl context
   gulong external_gl_context;
@@ -116,14 +203,21 @@ void gst_gl_display_create_context (GstGLDisplay * display,
     gulong external_gl_context);
 void gst_gl_display_destroy_context (GstGLDisplay * display);
 GstEGLBuffer *gst_gl_display_get_free_buffer(GstGLDisplay * display,
-    GstCaps *caps, guint size, gboolean check_platform);
+    GstCaps *caps, guint size, gboolean check_platform, gboolean wait,
+    GstGLDisplayAllocResult *result);
 gboolean gst_gl_display_redisplay (GstGLDisplay * display, GstEGLBuffer *buffer,
     gint window_width, gint window_height, gboolean keep_aspect_ratio);
 
-void gst_gl_display_gen_texture (GstGLDisplay * display, GstEGLBuffer *buffer);
+GstGLDisplayAllocResult gst_gl_display_gen_texture (GstGLDisplay * display,
+    GstEGLBuffer *buffer, gboolean wait);
 void gst_gl_display_del_texture (GstGLDisplay * display, GstEGLBuffer *buffer);
+void gst_gl_display_prealloc_textures (GstGLDisplay * display, GstCaps *caps, gint count);
+GstStructure *gst_gl_display_get_stats (GstGLDisplay * display);
+void gst_gl_display_trim_pool (GstGLDisplay * display);
+void gst_gl_display_set_idle_timeout (GstGLDisplay * display, GstClockTime timeout);
 
 gboolean gst_gl_display_do_upload (GstGLDisplay * display, GstEGLBuffer *buffer, GstBuffer *src);
+GstGLWindowFence *gst_gl_display_do_upload_async (GstGLDisplay * display, GstEGLBuffer *buffer, GstBuffer *src);
 
 void gst_gl_display_set_window_id (GstGLDisplay * display, gulong window_id);
 
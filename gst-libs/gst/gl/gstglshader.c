@@ -22,6 +22,13 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+#include <glib/gstdio.h>
+#include <GLES2/gl2.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GLES2/gl2ext.h>
+#undef GL_GLEXT_PROTOTYPES
+
 #include "gstglshader.h"
 
 #define GST_GL_SHADER_GET_PRIVATE(o)					\
@@ -33,7 +40,8 @@ enum
   PROP_VERTEX_SRC,
   PROP_FRAGMENT_SRC,
   PROP_COMPILED,
-  PROP_ACTIVE                   //unused
+  PROP_ACTIVE,                  //unused
+  PROP_BINARY_CACHE_DIR
 };
 
 struct _GstGLShaderPrivate
@@ -47,6 +55,30 @@ struct _GstGLShaderPrivate
 
   gboolean compiled;
   gboolean active;
+
+  gchar *binary_cache_dir;      //NULL disables the program binary cache
+
+  /* locations, filled at link time */
+  GHashTable *uniforms;         //name -> GstGLShaderUniform
+  GHashTable *attributes;       //name -> location
+};
+
+/* a uniform location and a shadow copy of its last value, so that setting
+ * the same value again does not reach the driver */
+struct _GstGLShaderUniform
+{
+  GLint location;
+  enum
+  {
+    UNIFORM_UNSET,
+    UNIFORM_INT,
+    UNIFORM_FLOAT
+  } type;
+  union
+  {
+    gint i;
+    gfloat f;
+  } value;
 };
 
 G_DEFINE_TYPE (GstGLShader, gst_gl_shader, G_TYPE_OBJECT);
@@ -70,8 +102,11 @@ gst_gl_shader_finalize (GObject * object)
 
   g_free (priv->vertex_src);
   g_free (priv->fragment_src);
+  g_free (priv->binary_cache_dir);
 
   /* release shader objects */
+  g_hash_table_destroy (priv->uniforms);
+  g_hash_table_destroy (priv->attributes);
   gst_gl_shader_release (shader);
 
   /* delete program */
@@ -105,6 +140,9 @@ gst_gl_shader_set_property (GObject * object,
     case PROP_FRAGMENT_SRC:
       gst_gl_shader_set_fragment_source (shader, g_value_get_string (value));
       break;
+    case PROP_BINARY_CACHE_DIR:
+      gst_gl_shader_set_binary_cache_dir (shader, g_value_get_string (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -128,6 +166,9 @@ gst_gl_shader_get_property (GObject * object,
     case PROP_COMPILED:
       g_value_set_boolean (value, priv->compiled);
       break;
+    case PROP_BINARY_CACHE_DIR:
+      g_value_set_string (value, priv->binary_cache_dir);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -144,6 +185,72 @@ gst_gl_shader_log_handler (const gchar * domain, GLogLevelFlags flags,
   }
 }
 
+static void
+gst_gl_shader_uniform_free (gpointer data)
+{
+  g_slice_free (GstGLShaderUniform, data);
+}
+
+static GstGLShaderUniform *
+gst_gl_shader_add_uniform (GstGLShader * shader, const gchar * name,
+    GLint location)
+{
+  GstGLShaderUniform *uniform = g_slice_new0 (GstGLShaderUniform);
+  uniform->location = location;
+  uniform->type = UNIFORM_UNSET;
+  g_hash_table_insert (shader->priv->uniforms, g_strdup (name), uniform);
+  return uniform;
+}
+
+/* Cache the location of every active uniform and attribute of the linked
+ * program so that the setters never ask the driver by name */
+static void
+gst_gl_shader_cache_locations (GstGLShader * shader)
+{
+  GstGLShaderPrivate *priv = shader->priv;
+  GLint count = 0, max_length = 0, i;
+  GLint size;
+  GLenum type;
+  gchar *name;
+
+  g_hash_table_remove_all (priv->uniforms);
+  g_hash_table_remove_all (priv->attributes);
+
+  glGetProgramiv (priv->program_handle, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv (priv->program_handle, GL_ACTIVE_UNIFORM_MAX_LENGTH,
+      &max_length);
+  name = g_malloc (max_length + 1);
+  for (i = 0; i < count; i++) {
+    GLint location;
+    glGetActiveUniform (priv->program_handle, i, max_length + 1, NULL, &size,
+        &type, name);
+    location = glGetUniformLocationARB (priv->program_handle, name);
+    gst_gl_shader_add_uniform (shader, name, location);
+    //arrays are reported as name[0] but usually set by their bare name
+    if (g_str_has_suffix (name, "[0]")) {
+      name[strlen (name) - 3] = '\0';
+      gst_gl_shader_add_uniform (shader, name, location);
+    }
+  }
+  g_free (name);
+
+  count = max_length = 0;
+  glGetProgramiv (priv->program_handle, GL_ACTIVE_ATTRIBUTES, &count);
+  glGetProgramiv (priv->program_handle, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH,
+      &max_length);
+  name = g_malloc (max_length + 1);
+  for (i = 0; i < count; i++) {
+    glGetActiveAttrib (priv->program_handle, i, max_length + 1, NULL, &size,
+        &type, name);
+    g_hash_table_insert (priv->attributes, g_strdup (name),
+        GINT_TO_POINTER (glGetAttribLocationARB (priv->program_handle, name)));
+  }
+  g_free (name);
+
+  g_debug ("cached %u uniforms and %u attributes",
+      g_hash_table_size (priv->uniforms), g_hash_table_size (priv->attributes));
+}
+
 static void
 gst_gl_shader_class_init (GstGLShaderClass * klass)
 {
@@ -177,6 +284,12 @@ gst_gl_shader_class_init (GstGLShaderClass * klass)
       g_param_spec_boolean ("compiled",
           "Compiled",
           "Shader compile and link status", FALSE, G_PARAM_READABLE));
+  g_object_class_install_property (obj_class,
+      PROP_BINARY_CACHE_DIR,
+      g_param_spec_string ("binary-cache-dir",
+          "Binary cache directory",
+          "Directory where linked program binaries are cached, "
+          "NULL to always compile from source", NULL, G_PARAM_READWRITE));
 }
 
 void
@@ -215,6 +328,20 @@ gst_gl_shader_set_fragment_source (GstGLShader * shader, const gchar * src)
   priv->fragment_src = g_strdup (src);
 }
 
+void
+gst_gl_shader_set_binary_cache_dir (GstGLShader * shader, const gchar * dir)
+{
+  GstGLShaderPrivate *priv;
+
+  g_return_if_fail (GST_GL_IS_SHADER (shader));
+
+  priv = shader->priv;
+
+  g_free (priv->binary_cache_dir);
+
+  priv->binary_cache_dir = g_strdup (dir);
+}
+
 G_CONST_RETURN gchar *
 gst_gl_shader_get_vertex_source (GstGLShader * shader)
 {
@@ -248,6 +375,11 @@ gst_gl_shader_init (GstGLShader * self)
 
   priv->compiled = FALSE;
   priv->active = FALSE;         // unused at the moment
+  priv->binary_cache_dir = NULL;
+  priv->uniforms = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      gst_gl_shader_uniform_free);
+  priv->attributes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      NULL);
 
   if (g_getenv ("GST_GL_SHADER_DEBUG") != NULL)
     _gst_gl_shader_debug = TRUE;
@@ -270,6 +402,107 @@ gst_gl_shader_is_compiled (GstGLShader * shader)
   return shader->priv->compiled;
 }
 
+/* Program binaries are only valid for the driver that produced them, so
+ * the cache file name hashes the sources together with the gl renderer and
+ * version strings. Returns NULL if the extension is not there */
+static gchar *
+gst_gl_shader_get_binary_path (GstGLShader * shader)
+{
+  GstGLShaderPrivate *priv = shader->priv;
+  const gchar *extensions;
+  GLint formats = 0;
+  GChecksum *checksum;
+  gchar *name, *path;
+
+  extensions = (const gchar *) glGetString (GL_EXTENSIONS);
+  if (!extensions || !strstr (extensions, "GL_OES_get_program_binary"))
+    return NULL;
+  glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+  if (formats <= 0)
+    return NULL;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA1);
+  if (priv->vertex_src)
+    g_checksum_update (checksum, (const guchar *) priv->vertex_src, -1);
+  g_checksum_update (checksum, (const guchar *) "", 1);
+  if (priv->fragment_src)
+    g_checksum_update (checksum, (const guchar *) priv->fragment_src, -1);
+  g_checksum_update (checksum, (const guchar *) "", 1);
+  g_checksum_update (checksum, glGetString (GL_RENDERER), -1);
+  g_checksum_update (checksum, (const guchar *) "", 1);
+  g_checksum_update (checksum, glGetString (GL_VERSION), -1);
+
+  name = g_strconcat (g_checksum_get_string (checksum), ".bin", NULL);
+  path = g_build_filename (priv->binary_cache_dir, name, NULL);
+  g_free (name);
+  g_checksum_free (checksum);
+
+  return path;
+}
+
+/* A cache file is the binary format followed by the program binary */
+static gboolean
+gst_gl_shader_load_binary (GstGLShader * shader, const gchar * path)
+{
+  GstGLShaderPrivate *priv = shader->priv;
+  gchar *contents = NULL;
+  gsize length = 0;
+  guint32 format;
+  GLint status = GL_FALSE;
+
+  if (!g_file_get_contents (path, &contents, &length, NULL))
+    return FALSE;
+
+  if (length > sizeof (format)) {
+    memcpy (&format, contents, sizeof (format));
+    glProgramBinaryOES (priv->program_handle, format,
+        contents + sizeof (format), length - sizeof (format));
+    glGetProgramiv (priv->program_handle, GL_LINK_STATUS, &status);
+  }
+  g_free (contents);
+
+  if (status != GL_TRUE) {
+    //stale or corrupted, it is rewritten after the source build
+    g_debug ("program binary %s rejected", path);
+    g_unlink (path);
+    return FALSE;
+  }
+
+  g_debug ("program loaded from binary %s", path);
+  return TRUE;
+}
+
+static void
+gst_gl_shader_save_binary (GstGLShader * shader, const gchar * path)
+{
+  GstGLShaderPrivate *priv = shader->priv;
+  GLint length = 0;
+  GLsizei written = 0;
+  GLenum format = 0;
+  guint32 header;
+  gchar *contents;
+  GError *error = NULL;
+
+  glGetProgramiv (priv->program_handle, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+  if (length <= 0)
+    return;
+
+  contents = g_malloc (sizeof (header) + length);
+  glGetProgramBinaryOES (priv->program_handle, length, &written, &format,
+      contents + sizeof (header));
+  if (written > 0) {
+    header = format;
+    memcpy (contents, &header, sizeof (header));
+    g_mkdir_with_parents (priv->binary_cache_dir, 0755);
+    if (!g_file_set_contents (path, contents, sizeof (header) + written,
+            &error)) {
+      g_debug ("failed to save program binary: %s", error->message);
+      g_error_free (error);
+    }
+  }
+  g_free (contents);
+}
+
 gboolean
 gst_gl_shader_compile (GstGLShader * shader, GError ** error)
 {
@@ -278,6 +511,7 @@ gst_gl_shader_compile (GstGLShader * shader, GError ** error)
   gchar info_buffer[2048];
   GLsizei len = 0;
   GLint status = GL_FALSE;
+  gchar *binary_path = NULL;
 
   g_return_val_if_fail (GST_GL_IS_SHADER (shader), FALSE);
 
@@ -288,6 +522,17 @@ gst_gl_shader_compile (GstGLShader * shader, GError ** error)
 
   g_assert (priv->program_handle);
 
+  if (priv->binary_cache_dir)
+    binary_path = gst_gl_shader_get_binary_path (shader);
+
+  if (binary_path && gst_gl_shader_load_binary (shader, binary_path)) {
+    g_free (binary_path);
+    gst_gl_shader_cache_locations (shader);
+    priv->compiled = TRUE;
+    g_object_notify (G_OBJECT (shader), "compiled");
+    return priv->compiled;
+  }
+
   if (priv->vertex_src) {
     /* create vertex object */
     const gchar *vertex_source = priv->vertex_src;
@@ -309,6 +554,7 @@ gst_gl_shader_compile (GstGLShader * shader, GError ** error)
           "Vertex Shader compilation failed:\n%s", info_buffer);
 
       glDeleteObjectARB (priv->vertex_handle);
+      g_free (binary_path);
       priv->compiled = FALSE;
       return priv->compiled;
     } else if (len > 1) {
@@ -337,6 +583,7 @@ gst_gl_shader_compile (GstGLShader * shader, GError ** error)
           "Fragment Shader compilation failed:\n%s", info_buffer);
 
       glDeleteObjectARB (priv->fragment_handle);
+      g_free (binary_path);
       priv->compiled = FALSE;
       return priv->compiled;
     } else if (len > 1) {
@@ -357,11 +604,17 @@ gst_gl_shader_compile (GstGLShader * shader, GError ** error)
   if (status != GL_TRUE) {
     g_set_error (error, GST_GL_SHADER_ERROR,
         GST_GL_SHADER_ERROR_LINK, "Shader Linking failed:\n%s", info_buffer);
+    g_free (binary_path);
     priv->compiled = FALSE;
     return priv->compiled;
   } else if (len > 1) {
     g_debug ("\n%s\n", info_buffer);
   }
+  if (binary_path) {
+    gst_gl_shader_save_binary (shader, binary_path);
+    g_free (binary_path);
+  }
+  gst_gl_shader_cache_locations (shader);
   /* success! */
   priv->compiled = TRUE;
   g_object_notify (G_OBJECT (shader), "compiled");
@@ -408,6 +661,10 @@ gst_gl_shader_release (GstGLShader * shader)
   if (priv->fragment_handle)
     glDetachObjectARB (priv->program_handle, priv->fragment_handle);
 
+  //the program gets relinked, handles from gst_gl_shader_get_uniform die here
+  g_hash_table_remove_all (priv->uniforms);
+  g_hash_table_remove_all (priv->attributes);
+
   priv->compiled = FALSE;
   g_object_notify (G_OBJECT (shader), "compiled");
 }
@@ -466,80 +723,113 @@ gst_gl_shader_compile_and_check (GstGLShader * shader,
   return TRUE;
 }
 
-void
-gst_gl_shader_set_uniform_1f (GstGLShader * shader, const gchar * name,
-    gfloat value)
+/* Look a uniform up in the cache, names that are not active in the program
+ * get a -1 location so they are asked to the driver only once */
+GstGLShaderUniform *
+gst_gl_shader_get_uniform (GstGLShader * shader, const gchar * name)
 {
   GstGLShaderPrivate *priv;
-  GLint location = -1;
+  GstGLShaderUniform *uniform;
 
   priv = shader->priv;
 
-  g_return_if_fail (priv->program_handle != 0);
+  g_return_val_if_fail (priv->program_handle != 0, NULL);
 
-  location = glGetUniformLocationARB (priv->program_handle, name);
+  uniform = g_hash_table_lookup (priv->uniforms, name);
+  if (!uniform)
+    uniform = gst_gl_shader_add_uniform (shader, name,
+        glGetUniformLocationARB (priv->program_handle, name));
 
-  glUniform1fARB (location, value);
+  return uniform;
 }
 
 void
-gst_gl_shader_set_uniform_1fv (GstGLShader * shader, const gchar * name,
-    guint count, gfloat * value)
+gst_gl_shader_set_uniform_1i_handle (GstGLShader * shader,
+    GstGLShaderUniform * uniform, gint value)
 {
-  GstGLShaderPrivate *priv;
-  GLint location = -1;
+  g_return_if_fail (uniform != NULL);
 
-  priv = shader->priv;
+  if (uniform->type == UNIFORM_INT && uniform->value.i == value)
+    return;
 
-  g_return_if_fail (priv->program_handle != 0);
+  glUniform1iARB (uniform->location, value);
+  uniform->type = UNIFORM_INT;
+  uniform->value.i = value;
+}
 
-  location = glGetUniformLocationARB (priv->program_handle, name);
+void
+gst_gl_shader_set_uniform_1f_handle (GstGLShader * shader,
+    GstGLShaderUniform * uniform, gfloat value)
+{
+  g_return_if_fail (uniform != NULL);
+
+  if (uniform->type == UNIFORM_FLOAT && uniform->value.f == value)
+    return;
 
-  glUniform1fvARB (location, count, value);
+  glUniform1fARB (uniform->location, value);
+  uniform->type = UNIFORM_FLOAT;
+  uniform->value.f = value;
 }
 
 void
-gst_gl_shader_set_uniform_1i (GstGLShader * shader, const gchar * name,
-    gint value)
+gst_gl_shader_set_uniform_1f (GstGLShader * shader, const gchar * name,
+    gfloat value)
 {
-  GstGLShaderPrivate *priv;
-  GLint location = -1;
+  gst_gl_shader_set_uniform_1f_handle (shader,
+      gst_gl_shader_get_uniform (shader, name), value);
+}
 
-  priv = shader->priv;
+void
+gst_gl_shader_set_uniform_1fv (GstGLShader * shader, const gchar * name,
+    guint count, gfloat * value)
+{
+  GstGLShaderUniform *uniform = gst_gl_shader_get_uniform (shader, name);
 
-  g_return_if_fail (priv->program_handle != 0);
+  g_return_if_fail (uniform != NULL);
 
-  location = glGetUniformLocationARB (priv->program_handle, name);
+  //arrays are not shadowed
+  uniform->type = UNIFORM_UNSET;
+  glUniform1fvARB (uniform->location, count, value);
+}
 
-  glUniform1iARB (location, value);
+void
+gst_gl_shader_set_uniform_1i (GstGLShader * shader, const gchar * name,
+    gint value)
+{
+  gst_gl_shader_set_uniform_1i_handle (shader,
+      gst_gl_shader_get_uniform (shader, name), value);
 }
 
 void
 gst_gl_shader_set_uniform_matrix_4fv (GstGLShader * shader, const gchar * name,
     GLsizei count, GLboolean transpose, const GLfloat* value)
 {
-  GstGLShaderPrivate *priv;
-  GLint location = -1;
-
-  priv = shader->priv;
+  GstGLShaderUniform *uniform = gst_gl_shader_get_uniform (shader, name);
 
-  g_return_if_fail (priv->program_handle != 0);
-
-  location = glGetUniformLocationARB (priv->program_handle, name);
+  g_return_if_fail (uniform != NULL);
 
-  glUniformMatrix4fvARB (location, count, transpose, value);
+  uniform->type = UNIFORM_UNSET;
+  glUniformMatrix4fvARB (uniform->location, count, transpose, value);
 }
 
 GLint
 gst_gl_shader_get_attribute_location (GstGLShader * shader, const gchar * name)
 {
   GstGLShaderPrivate *priv;
+  gpointer location;
+  GLint ret;
 
   priv = shader->priv;
 
   g_return_val_if_fail (priv->program_handle != 0, 0);
 
-  return glGetAttribLocationARB (priv->program_handle, name);
+  if (g_hash_table_lookup_extended (priv->attributes, name, NULL, &location))
+    return GPOINTER_TO_INT (location);
+
+  ret = glGetAttribLocationARB (priv->program_handle, name);
+  g_hash_table_insert (priv->attributes, g_strdup (name),
+      GINT_TO_POINTER (ret));
+  return ret;
 }
 
 void
@@ -551,6 +841,7 @@ gst_gl_shader_bind_attribute_location (GstGLShader * shader, GLuint index, const
 
   g_return_if_fail (priv->program_handle != 0);
 
+  //only effective at the next link, which refills the cache
   glBindAttribLocationARB (priv->program_handle, index, name);
 }
 
@@ -50,6 +50,7 @@ typedef enum {
 typedef struct _GstGLShader        GstGLShader;
 typedef struct _GstGLShaderPrivate GstGLShaderPrivate;
 typedef struct _GstGLShaderClass   GstGLShaderClass;
+typedef struct _GstGLShaderUniform GstGLShaderUniform;
 
 struct _GstGLShader {
   /*< private >*/
@@ -73,6 +74,8 @@ void gst_gl_shader_set_vertex_source   (GstGLShader *shader,
 					const gchar *src);
 void gst_gl_shader_set_fragment_source (GstGLShader *shader, 
 					const gchar *src);
+void gst_gl_shader_set_binary_cache_dir (GstGLShader *shader,
+					const gchar *dir);
 G_CONST_RETURN gchar * gst_gl_shader_get_vertex_source (GstGLShader *shader);
 G_CONST_RETURN gchar * gst_gl_shader_get_fragment_source (GstGLShader *shader);
 
@@ -92,6 +95,11 @@ void gst_gl_shader_set_uniform_1fv (GstGLShader *shader, const gchar *name, guin
 void gst_gl_shader_set_uniform_matrix_4fv (GstGLShader * shader, const gchar * name,
   GLsizei count, GLboolean transpose, const GLfloat* value);
 
+/* handles stay valid until the shader is released or compiled again */
+GstGLShaderUniform * gst_gl_shader_get_uniform (GstGLShader *shader, const gchar *name);
+void gst_gl_shader_set_uniform_1i_handle (GstGLShader *shader, GstGLShaderUniform *uniform, gint value);
+void gst_gl_shader_set_uniform_1f_handle (GstGLShader *shader, GstGLShaderUniform *uniform, gfloat value);
+
 GLint gst_gl_shader_get_attribute_location (GstGLShader *shader, const gchar *name);
 void gst_gl_shader_bind_attribute_location (GstGLShader * shader, GLuint index, const gchar * name);
 
@@ -44,6 +44,7 @@ typedef void (* GstGLWindowCB2) ( gpointer, gint, gint );
 typedef struct _GstGLWindow        GstGLWindow;
 typedef struct _GstGLWindowPrivate GstGLWindowPrivate;
 typedef struct _GstGLWindowClass   GstGLWindowClass;
+typedef struct _GstGLWindowFence   GstGLWindowFence;
 
 struct _GstGLWindow {
   /*< private >*/
@@ -70,15 +71,24 @@ void gst_gl_window_set_external_window_id (GstGLWindow *window, gulong id);
 void gst_gl_window_set_draw_callback (GstGLWindow *window, GstGLWindowCB draw, GstGLWindowCB draw_finish, gpointer data);
 void gst_gl_window_set_resize_callback (GstGLWindow *window, GstGLWindowCB2 callback, gpointer data);
 void gst_gl_window_set_close_callback (GstGLWindow *window, GstGLWindowCB callback, gpointer data);
+void gst_gl_window_set_timeout_callback (GstGLWindow *window, GstGLWindowCB callback, gpointer data, GstClockTime interval);
 
 void gst_gl_window_draw_unlocked (GstGLWindow *window, gint width, gint height);
 void gst_gl_window_draw (GstGLWindow *window, gint width, gint height);
 void gst_gl_window_run_loop (GstGLWindow *window);
 void gst_gl_window_quit_loop (GstGLWindow *window, GstGLWindowCB callback, gpointer data);
 
-void gst_gl_window_send_message (GstGLWindow *window, GstGLWindowCB callback, gpointer data);
+gboolean gst_gl_window_send_message (GstGLWindow *window, GstGLWindowCB callback, gpointer data);
+void gst_gl_window_post_message (GstGLWindow *window, GstGLWindowCB callback, gpointer data);
+GstGLWindowFence * gst_gl_window_submit_message (GstGLWindow *window, GstGLWindowCB callback, gpointer data);
+
+GstGLWindowFence * gst_gl_window_fence_ref (GstGLWindowFence *fence);
+void gst_gl_window_fence_unref (GstGLWindowFence *fence);
+gboolean gst_gl_window_fence_is_done (GstGLWindowFence *fence);
+void gst_gl_window_fence_wait (GstGLWindowFence *fence);
 
 EGLDisplay gst_gl_window_get_egl_display (GstGLWindow * window);
+void gst_gl_window_add_stats (GstGLWindow *window, GstStructure *stats);
 
 /* helper */
 void gst_gl_window_init_platform ();
@@ -25,6 +25,10 @@
 #include "gstglwindow.h"
 
 #include <locale.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
@@ -45,15 +49,58 @@ enum
   ARG_DISPLAY
 };
 
+/* Completion token of a gst_gl_window_submit_message call, it has its
+ * own lock so that it can be waited on without the x lock and outlive
+ * the window */
+struct _GstGLWindowFence
+{
+  volatile gint ref_count;
+  volatile gint done;
+  GMutex *lock;
+  GCond *cond;
+};
+
+/* A call to run in the gl thread, queued by gst_gl_window_send_message,
+ * gst_gl_window_post_message, gst_gl_window_submit_message or
+ * gst_gl_window_quit_loop */
+typedef struct _GstGLWindowJob
+{
+  GstGLWindowCB callback;
+  gpointer data;
+  gboolean quit;
+  gboolean blocking;
+  gboolean done;
+  GstGLWindowFence *fence;
+} GstGLWindowJob;
+
 struct _GstGLWindowPrivate
 {
-  /* X is not thread safe */
+  /* X is not thread safe, the gl thread does not hold it while
+   * it runs jobs or draws */
   GMutex *x_lock;
+  GMutex *send_lock;
   GCond *cond_send_message;
-  gboolean running;
+  volatile gint running;
+  volatile gint pushers;      //threads queueing a job, see gst_gl_window_push_job
   gboolean visible;
   gboolean allow_extra_expose_events;
 
+  /* Wakes up the gl thread without going through the X server */
+  gint wake_fds[2];
+  volatile gint draw_requests;
+  GAsyncQueue *jobs;
+
+  /* Set when the window has to be mapped or resized to its parent
+   * before the next frame, gst_gl_window_draw only takes the x lock then */
+  volatile gint geometry_pending;
+
+  /* gl loop counters, under the x lock */
+  guint64 stat_job_wakeups;
+  guint64 stat_jobs;
+  guint stat_max_jobs;
+  guint64 stat_draws;
+  guint64 stat_draws_coalesced;
+
   /* X context */
   gchar *display_name;
   Display *device;
@@ -67,6 +114,14 @@ struct _GstGLWindowPrivate
   Window parent;
   Window internal_win_id;
 
+  /* Geometry kept up to date from ConfigureNotify, so that
+   * drawing a frame never has to query the X server */
+  gint win_width;
+  gint win_height;
+  gint parent_width;
+  gint parent_height;
+  gboolean parent_changed;
+
   /* We use a specific connection to send events */
   Display *disp_send;
 
@@ -83,6 +138,10 @@ struct _GstGLWindowPrivate
   gpointer resize_data;
   GstGLWindowCB close_cb;
   gpointer close_data;
+  GstGLWindowCB timeout_cb;
+  gpointer timeout_data;
+  GstClockTime timeout_interval;
+  GstClockTime timeout_next;
 };
 
 G_DEFINE_TYPE (GstGLWindow, gst_gl_window, G_TYPE_OBJECT);
@@ -96,6 +155,17 @@ void gst_gl_window_init_platform ()
 {
 }
 
+/* Marks the fence as done and drops the reference of its job */
+static void
+gst_gl_window_fence_signal (GstGLWindowFence * fence)
+{
+  g_mutex_lock (fence->lock);
+  g_atomic_int_set (&fence->done, TRUE);
+  g_cond_broadcast (fence->cond);
+  g_mutex_unlock (fence->lock);
+  gst_gl_window_fence_unref (fence);
+}
+
 /* Must be called in the gl thread */
 static void
 gst_gl_window_finalize (GObject * object)
@@ -160,6 +230,31 @@ gst_gl_window_finalize (GObject * object)
     priv->cond_send_message = NULL;
   }
 
+  if (priv->send_lock) {
+    g_mutex_free (priv->send_lock);
+    priv->send_lock = NULL;
+  }
+
+  if (priv->jobs) {
+    GstGLWindowJob *job;
+
+    while ((job = g_async_queue_try_pop (priv->jobs)))
+      if (!job->blocking) {
+        //never executed, but nobody must wait for it forever
+        if (job->fence)
+          gst_gl_window_fence_signal (job->fence);
+        g_slice_free (GstGLWindowJob, job);
+      }
+    g_async_queue_unref (priv->jobs);
+    priv->jobs = NULL;
+  }
+
+  if (priv->wake_fds[0] >= 0) {
+    close (priv->wake_fds[0]);
+    close (priv->wake_fds[1]);
+    priv->wake_fds[0] = priv->wake_fds[1] = -1;
+  }
+
   g_mutex_unlock (priv->x_lock);
 
   if (priv->x_lock) {
@@ -282,7 +377,7 @@ gst_gl_window_new (gulong external_gl_context)
   XWMHints wm_hints;
   unsigned long mask;
   const gchar *title = "EGL X11 renderer";
-  Atom wm_atoms[3];
+  Atom wm_atoms[1];
 
   static gint x = 0;
   static gint y = 0;
@@ -290,11 +385,37 @@ gst_gl_window_new (gulong external_gl_context)
   setlocale (LC_NUMERIC, "C");
 
   priv->x_lock = g_mutex_new ();
+  priv->send_lock = g_mutex_new ();
   priv->cond_send_message = g_cond_new ();
   priv->running = TRUE;
+  priv->pushers = 0;
   priv->visible = FALSE;
+  priv->geometry_pending = TRUE;
   priv->parent = 0;
+  priv->parent_changed = FALSE;
+  priv->win_width = 1;
+  priv->win_height = 1;
+  priv->parent_width = 0;
+  priv->parent_height = 0;
   priv->allow_extra_expose_events = TRUE;
+  priv->draw_requests = 0;
+  priv->jobs = g_async_queue_new ();
+  priv->stat_job_wakeups = 0;
+  priv->stat_jobs = 0;
+  priv->stat_max_jobs = 0;
+  priv->stat_draws = 0;
+  priv->stat_draws_coalesced = 0;
+
+  if (pipe (priv->wake_fds) == 0) {
+    fcntl (priv->wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl (priv->wake_fds[1], F_SETFL, O_NONBLOCK);
+    fcntl (priv->wake_fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl (priv->wake_fds[1], F_SETFD, FD_CLOEXEC);
+  } else {
+    g_warning ("failed to create the gl thread wake up pipe: %s",
+        g_strerror (errno));
+    priv->wake_fds[0] = priv->wake_fds[1] = -1;
+  }
 
   g_mutex_lock (priv->x_lock);
 
@@ -356,15 +477,7 @@ gst_gl_window_new (gulong external_gl_context)
   if (wm_atoms[0] == None)
     g_debug ("Cannot create WM_DELETE_WINDOW\n");
 
-  wm_atoms[1] = XInternAtom (priv->device, "WM_GL_WINDOW", False);
-  if (wm_atoms[1] == None)
-    g_debug ("Cannot create WM_GL_WINDOW\n");
-
-  wm_atoms[2] = XInternAtom (priv->device, "WM_QUIT_LOOP", False);
-  if (wm_atoms[2] == None)
-    g_debug ("Cannot create WM_QUIT_LOOP\n");
-
-  XSetWMProtocols (priv->device, priv->internal_win_id, wm_atoms, 2);
+  XSetWMProtocols (priv->device, priv->internal_win_id, wm_atoms, 1);
 
   wm_hints.flags = StateHint;
   wm_hints.initial_state = NormalState;
@@ -465,6 +578,17 @@ gst_gl_window_activate_gl_context (GstGLWindow * window, gboolean activate)
         GST_GL_WINDOW_CB (callback_inactivate_gl_context), priv);
 }
 
+/* Not called by the gl thread */
+static void
+gst_gl_window_wake_up (GstGLWindowPrivate * priv)
+{
+  const gchar byte = 0;
+
+  //a full pipe already has a wake up pending
+  if (priv->wake_fds[1] >= 0)
+    while (write (priv->wake_fds[1], &byte, 1) < 0 && errno == EINTR);
+}
+
 /* Not called by the gl thread */
 void
 gst_gl_window_set_external_window_id (GstGLWindow * window, gulong id)
@@ -481,6 +605,11 @@ gst_gl_window_set_external_window_id (GstGLWindow * window, gulong id)
 
     XGetWindowAttributes (priv->disp_send, priv->parent, &attr);
 
+    priv->parent_width = attr.width;
+    priv->parent_height = attr.height;
+    priv->win_width = attr.width;
+    priv->win_height = attr.height;
+
     XResizeWindow (priv->disp_send, priv->internal_win_id, attr.width,
         attr.height);
 
@@ -489,6 +618,12 @@ gst_gl_window_set_external_window_id (GstGLWindow * window, gulong id)
 
     XSync (priv->disp_send, FALSE);
 
+    //the gl thread selects the parent's structure events on its own
+    //connection, so that parent resizes come back as ConfigureNotify
+    priv->parent_changed = TRUE;
+    g_atomic_int_set (&priv->geometry_pending, TRUE);
+    gst_gl_window_wake_up (priv);
+
     g_mutex_unlock (priv->x_lock);
   }
 }
@@ -536,97 +671,251 @@ gst_gl_window_set_close_callback (GstGLWindow * window, GstGLWindowCB callback,
   g_mutex_unlock (priv->x_lock);
 }
 
-/* Called in the gl thread */
+/* Not called by the gl thread. callback is called in the gl thread
+ * every interval, whether frames are drawn or not. 0 disables it */
 void
-gst_gl_window_draw_unlocked (GstGLWindow * window, gint width, gint height)
+gst_gl_window_set_timeout_callback (GstGLWindow * window,
+    GstGLWindowCB callback, gpointer data, GstClockTime interval)
 {
   GstGLWindowPrivate *priv = window->priv;
 
-  if (priv->running && priv->allow_extra_expose_events) {
-    XEvent event;
-    XWindowAttributes attr;
+  g_mutex_lock (priv->x_lock);
+
+  priv->timeout_cb = interval ? callback : NULL;
+  priv->timeout_data = data;
+  priv->timeout_interval = interval;
+  priv->timeout_next = gst_util_get_timestamp () + interval;
 
-    XGetWindowAttributes (priv->device, priv->internal_win_id, &attr);
-
-    event.xexpose.type = Expose;
-    event.xexpose.send_event = TRUE;
-    event.xexpose.display = priv->device;
-    event.xexpose.window = priv->internal_win_id;
-    event.xexpose.x = attr.x;
-    event.xexpose.y = attr.y;
-    event.xexpose.width = attr.width;
-    event.xexpose.height = attr.height;
-    event.xexpose.count = 0;
-
-    XSendEvent (priv->device, priv->internal_win_id, FALSE, ExposureMask,
-        &event);
-    XFlush(priv->device);
+  //the loop may be sleeping with no timeout or a longer one
+  gst_gl_window_wake_up (priv);
+
+  g_mutex_unlock (priv->x_lock);
+}
+
+/* Called in the gl thread without the x lock */
+static void
+gst_gl_window_run_timeout (GstGLWindowPrivate * priv)
+{
+  GstGLWindowCB timeout_cb = NULL;
+  gpointer timeout_data = NULL;
+  GstClockTime now = gst_util_get_timestamp ();
+
+  g_mutex_lock (priv->x_lock);
+  if (priv->timeout_cb && now >= priv->timeout_next) {
+    timeout_cb = priv->timeout_cb;
+    timeout_data = priv->timeout_data;
+    priv->timeout_next = now + priv->timeout_interval;
   }
+  g_mutex_unlock (priv->x_lock);
+
+  if (timeout_cb)
+    timeout_cb (timeout_data);
 }
 
-/* Not called by the gl thread */
+/* Called in the gl thread, sleeps until there is either an X event,
+ * a draw request or a job to handle, or the timeout callback is due */
+static void
+gst_gl_window_wait_events (GstGLWindowPrivate * priv)
+{
+  struct pollfd fds[2];
+  gchar buf[64];
+  gint timeout = -1;
+
+  if (g_atomic_int_get (&priv->draw_requests) > 0 ||
+      g_async_queue_length (priv->jobs) > 0 || XPending (priv->device))
+    return;
+
+  g_mutex_lock (priv->x_lock);
+  if (priv->timeout_cb) {
+    GstClockTime now = gst_util_get_timestamp ();
+    timeout = priv->timeout_next > now ?
+        (gint) MIN ((priv->timeout_next - now + GST_MSECOND - 1) / GST_MSECOND,
+        G_MAXINT) : 0;
+  }
+  g_mutex_unlock (priv->x_lock);
+
+  if (priv->wake_fds[0] < 0)
+    timeout = timeout < 0 ? 10 : MIN (timeout, 10);
+
+  fds[0].fd = ConnectionNumber (priv->device);
+  fds[0].events = POLLIN;
+  fds[0].revents = 0;
+  fds[1].fd = priv->wake_fds[0];
+  fds[1].events = POLLIN;
+  fds[1].revents = 0;
+
+  //without a wake up pipe, fall back to polling for jobs
+  while (poll (fds, priv->wake_fds[0] >= 0 ? 2 : 1, timeout) < 0
+      && errno == EINTR);
+
+  if (fds[1].revents & POLLIN)
+    while (read (priv->wake_fds[0], buf, sizeof (buf)) > 0);
+}
+
+/* Called in the gl thread without the x lock */
+static void
+gst_gl_window_redraw (GstGLWindowPrivate * priv)
+{
+  GstGLWindowCB draw_cb, draw_finish_cb;
+  gpointer draw_data;
+
+  g_mutex_lock (priv->x_lock);
+  draw_cb = priv->draw_cb;
+  draw_finish_cb = priv->draw_finish_cb;
+  draw_data = priv->draw_data;
+  g_mutex_unlock (priv->x_lock);
+
+  if (draw_cb) {
+    draw_cb (draw_data);
+    eglSwapBuffers (priv->gl_display, priv->gl_surface);
+    draw_finish_cb (draw_data);
+  }
+}
+
+/* Not called by the gl thread. Jobs are queued without the x lock so
+ * that a producer never waits for a draw or a swap, pushers lets
+ * gst_gl_window_quit wait for a push that raced with it */
+static gboolean
+gst_gl_window_push_job (GstGLWindowPrivate * priv, GstGLWindowJob * job)
+{
+  gboolean pushed = FALSE;
+
+  g_atomic_int_inc (&priv->pushers);
+  if (g_atomic_int_get (&priv->running)) {
+    g_async_queue_push (priv->jobs, job);
+    gst_gl_window_wake_up (priv);
+    pushed = TRUE;
+  }
+  g_atomic_int_add (&priv->pushers, -1);
+
+  return pushed;
+}
+
+/* Called in the gl thread without the x lock */
+static void
+gst_gl_window_run_job (GstGLWindowPrivate * priv, GstGLWindowJob * job)
+{
+  if (!job->callback || !job->data)
+    g_debug ("custom cb not initialized\n");
+  else
+    job->callback (job->data);
+
+  if (job->blocking) {
+    //the job lives on the stack of its sender
+    g_mutex_lock (priv->send_lock);
+    job->done = TRUE;
+    g_cond_broadcast (priv->cond_send_message);
+    g_mutex_unlock (priv->send_lock);
+  } else {
+    if (job->fence)
+      gst_gl_window_fence_signal (job->fence);
+    g_slice_free (GstGLWindowJob, job);
+  }
+}
+
+/* Called in the gl thread without the x lock */
+static void
+gst_gl_window_quit (GstGLWindowPrivate * priv, GstGLWindowJob * quit)
+{
+  GstGLWindowJob *job;
+
+  g_debug ("Quit loop message %lud\n", (gulong) priv->internal_win_id);
+
+  /* exit loop */
+  g_atomic_int_set (&priv->running, FALSE);
+
+  /* nothing can be queued once running is FALSE and the pushes
+   * that saw it TRUE are done */
+  while (g_atomic_int_get (&priv->pushers) > 0)
+    g_thread_yield ();
+
+  /* make sure last pendings send message calls are executed */
+  while ((job = g_async_queue_try_pop (priv->jobs))) {
+    if (job->quit) {
+      g_slice_free (GstGLWindowJob, job);
+      continue;
+    }
+    g_debug ("execute last pending custom jobs\n");
+    gst_gl_window_run_job (priv, job);
+  }
+
+  /* Finally we can destroy opengl ressources (texture/shaders/fbo) */
+  if (!quit->callback || !quit->data)
+    g_debug ("destroy cb not correclty set\n");
+  else
+    quit->callback (quit->data);
+
+  g_slice_free (GstGLWindowJob, quit);
+}
+
+/* Called in the gl thread */
+void
+gst_gl_window_draw_unlocked (GstGLWindow * window, gint width, gint height)
+{
+  GstGLWindowPrivate *priv = window->priv;
+
+  //the loop looks at the draw requests before going to sleep,
+  //so there is nothing to wake up
+  if (g_atomic_int_get (&priv->running))
+    g_atomic_int_inc (&priv->draw_requests);
+}
+
+/* Not called by the gl thread. Only the first frame and a parent
+ * resize take the x lock, any other frame is a request to the gl
+ * thread that never waits for the draw in progress */
 void
 gst_gl_window_draw (GstGLWindow * window, gint width, gint height)
 {
   if (window) {
     GstGLWindowPrivate *priv = window->priv;
 
-    g_mutex_lock (priv->x_lock);
+    if (!g_atomic_int_get (&priv->running))
+      return;
 
-    if (priv->running) {
-      XEvent event;
-      XWindowAttributes attr;
+    if (g_atomic_int_get (&priv->geometry_pending)) {
+      g_mutex_lock (priv->x_lock);
 
-      XGetWindowAttributes (priv->disp_send, priv->internal_win_id, &attr);
+      g_atomic_int_set (&priv->geometry_pending, FALSE);
 
       if (!priv->visible) {
 
         if (!priv->parent) {
-          attr.width = width;
-          attr.height = height;
+          priv->win_width = width;
+          priv->win_height = height;
           XResizeWindow (priv->disp_send, priv->internal_win_id,
-              attr.width, attr.height);
+              width, height);
           XSync (priv->disp_send, FALSE);
         }
 
+        //nothing else flushes the sender connection once the
+        //geometry is cached, the map would stay in the output buffer
         XMapWindow (priv->disp_send, priv->internal_win_id);
+        XFlush (priv->disp_send);
         priv->visible = TRUE;
       }
 
       if (priv->parent) {
-        XWindowAttributes attr_parent;
-        XGetWindowAttributes (priv->disp_send, priv->parent, &attr_parent);
-
-        if (attr.width != attr_parent.width ||
-            attr.height != attr_parent.height) {
+        if (priv->win_width != priv->parent_width ||
+            priv->win_height != priv->parent_height) {
           XMoveResizeWindow (priv->disp_send, priv->internal_win_id,
-              0, 0, attr_parent.width, attr_parent.height);
-          XSync (priv->disp_send, FALSE);
+              0, 0, priv->parent_width, priv->parent_height);
+          XFlush (priv->disp_send);
 
-          attr.width = attr_parent.width;
-          attr.height = attr_parent.height;
+          priv->win_width = priv->parent_width;
+          priv->win_height = priv->parent_height;
 
           g_debug ("parent resize:  %d, %d\n",
-              attr_parent.width, attr_parent.height);
+              priv->parent_width, priv->parent_height);
         }
       }
 
-      event.xexpose.type = Expose;
-      event.xexpose.send_event = TRUE;
-      event.xexpose.display = priv->disp_send;
-      event.xexpose.window = priv->internal_win_id;
-      event.xexpose.x = attr.x;
-      event.xexpose.y = attr.y;
-      event.xexpose.width = attr.width;
-      event.xexpose.height = attr.height;
-      event.xexpose.count = 0;
-
-      XSendEvent (priv->disp_send, priv->internal_win_id, FALSE, ExposureMask,
-          &event);
-      XFlush(priv->disp_send);
+      g_mutex_unlock (priv->x_lock);
     }
 
-    g_mutex_unlock (priv->x_lock);
+    //draw straight from the gl thread instead of bouncing
+    //a synthetic Expose off the X server
+    g_atomic_int_inc (&priv->draw_requests);
+    gst_gl_window_wake_up (priv);
   }
 }
 
@@ -638,67 +927,79 @@ gst_gl_window_run_loop (GstGLWindow * window)
 
   g_debug ("begin loop\n");
 
-  g_mutex_lock (priv->x_lock);
-
-  while (priv->running) {
+  while (g_atomic_int_get (&priv->running)) {
     XEvent event;
-    XEvent pending_event;
+    GstGLWindowJob *job;
+    guint n_jobs = 0;
+    gint requests;
+    gboolean expose = FALSE;
+
+    gst_gl_window_wait_events (priv);
+
+    //run everything that was queued during the sleep in one pass, the
+    //x lock is not held so that queueing a job never waits for it
+    while (g_atomic_int_get (&priv->running)
+        && (job = g_async_queue_try_pop (priv->jobs))) {
+      if (job->quit)
+        gst_gl_window_quit (priv, job);
+      else
+        gst_gl_window_run_job (priv, job);
+      n_jobs++;
+    }
 
-    g_mutex_unlock (priv->x_lock);
+    if (!g_atomic_int_get (&priv->running))
+      break;
 
-    /* XSendEvent (which are called in other threads) are done from another display structure */
-    XNextEvent (priv->device, &event);
+    //all the requests made so far are served by a single draw, the
+    //draw callback asks for another one if it still has frames queued
+    requests = g_atomic_int_get (&priv->draw_requests);
+    if (requests > 0) {
+      g_atomic_int_add (&priv->draw_requests, -requests);
+      gst_gl_window_redraw (priv);
+    }
+
+    gst_gl_window_run_timeout (priv);
 
     g_mutex_lock (priv->x_lock);
 
+    if (n_jobs) {
+      priv->stat_job_wakeups++;
+      priv->stat_jobs += n_jobs;
+      priv->stat_max_jobs = MAX (priv->stat_max_jobs, n_jobs);
+    }
+    if (requests > 0) {
+      priv->stat_draws++;
+      priv->stat_draws_coalesced += requests - 1;
+    }
+
+    if (priv->parent_changed) {
+      if (priv->parent)
+        XSelectInput (priv->device, priv->parent, StructureNotifyMask);
+      priv->parent_changed = FALSE;
+    }
+
+    if (!XPending (priv->device)) {
+      g_mutex_unlock (priv->x_lock);
+      continue;
+    }
+
+    /* gl jobs and draw requests never go through the X server, only
+     * real window events are left on this connection */
+    XNextEvent (priv->device, &event);
+
     // use in generic/cube and other related uses
     priv->allow_extra_expose_events = XPending (priv->device) <= 2;
 
     switch (event.type) {
       case ClientMessage:
       {
-
         Atom wm_delete = XInternAtom (priv->device, "WM_DELETE_WINDOW", True);
-        Atom wm_gl = XInternAtom (priv->device, "WM_GL_WINDOW", True);
-        Atom wm_quit_loop = XInternAtom (priv->device, "WM_QUIT_LOOP", True);
 
         if (wm_delete == None)
           g_debug ("Cannot create WM_DELETE_WINDOW\n");
-        if (wm_gl == None)
-          g_debug ("Cannot create WM_GL_WINDOW\n");
-        if (wm_quit_loop == None)
-          g_debug ("Cannot create WM_QUIT_LOOP\n");
-
-        /* Message sent with gst_gl_window_send_message */
-        if (wm_gl != None && event.xclient.message_type == wm_gl) {
-          //g_print("========ClientMessage got\n");
-          if (priv->running) {
-#if SIZEOF_VOID_P == 8
-            GstGLWindowCB custom_cb =
-                (GstGLWindowCB) (((event.xclient.data.
-                        l[0] & 0xffffffff) << 32) | (event.xclient.data.
-                    l[1] & 0xffffffff));
-            gpointer custom_data =
-                (gpointer) (((event.xclient.data.
-                        l[2] & 0xffffffff) << 32) | (event.xclient.data.
-                    l[3] & 0xffffffff));
-#else
-            GstGLWindowCB custom_cb = (GstGLWindowCB) event.xclient.data.l[0];
-            gpointer custom_data = (gpointer) event.xclient.data.l[1];
-#endif
-
-            if (!custom_cb || !custom_data)
-              g_debug ("custom cb not initialized\n");
-
-            //g_print("========Call customer callback %p, arg %p\n", custom_cb, custom_data);
-            custom_cb (custom_data);
-          }
-
-          g_cond_signal (priv->cond_send_message);
-        }
 
         /* User clicked on the cross */
-        else if (wm_delete != None
+        if (wm_delete != None
             && (Atom) event.xclient.data.l[0] == wm_delete) {
           g_debug ("Close %lud\n", (gulong) priv->internal_win_id);
 
@@ -712,70 +1013,32 @@ gst_gl_window_run_loop (GstGLWindow * window)
           priv->resize_data = NULL;
           priv->close_cb = NULL;
           priv->close_data = NULL;
-        }
-
-        /* message sent with gst_gl_window_quit_loop */
-        else if (wm_quit_loop != None
-            && event.xclient.message_type == wm_quit_loop) {
-#if SIZEOF_VOID_P == 8
-          GstGLWindowCB destroy_cb =
-              (GstGLWindowCB) (((event.xclient.data.
-                      l[0] & 0xffffffff) << 32) | (event.xclient.data.
-                  l[1] & 0xffffffff));
-          gpointer destroy_data =
-              (gpointer) (((event.xclient.data.
-                      l[2] & 0xffffffff) << 32) | (event.xclient.data.
-                  l[3] & 0xffffffff));
-#else
-          GstGLWindowCB destroy_cb = (GstGLWindowCB) event.xclient.data.l[0];
-          gpointer destroy_data = (gpointer) event.xclient.data.l[1];
-#endif
-
-          g_debug ("Quit loop message %lud\n", (gulong) priv->internal_win_id);
-
-          /* exit loop */
-          priv->running = FALSE;
-
-          /* make sure last pendings send message calls are executed */
-          XFlush (priv->device);
-          while (XCheckTypedEvent (priv->device, ClientMessage, &pending_event)) {
-#if SIZEOF_VOID_P == 8
-            GstGLWindowCB custom_cb =
-                (GstGLWindowCB) (((event.xclient.data.
-                        l[0] & 0xffffffff) << 32) | (event.xclient.data.
-                    l[1] & 0xffffffff));
-            gpointer custom_data =
-                (gpointer) (((event.xclient.data.
-                        l[2] & 0xffffffff) << 32) | (event.xclient.data.
-                    l[3] & 0xffffffff));
-#else
-            GstGLWindowCB custom_cb = (GstGLWindowCB) event.xclient.data.l[0];
-            gpointer custom_data = (gpointer) event.xclient.data.l[1];
-#endif
-            g_debug ("execute last pending custom x events\n");
-
-            if (!custom_cb || !custom_data)
-              g_debug ("custom cb not initialized\n");
-
-            custom_cb (custom_data);
-
-            g_cond_signal (priv->cond_send_message);
-          }
-
-          /* Finally we can destroy opengl ressources (texture/shaders/fbo) */
-          if (!destroy_cb || !destroy_data)
-            g_debug ("destroy cb not correclty set\n");
-
-          destroy_cb (destroy_data);
-
+          priv->timeout_cb = NULL;
+          priv->timeout_data = NULL;
         } else
           g_debug ("client message not reconized \n");
         break;
       }
 
       case CreateNotify:
+        if (priv->resize_cb)
+          priv->resize_cb (priv->resize_data, event.xcreatewindow.width,
+              event.xcreatewindow.height);
+        break;
+
       case ConfigureNotify:
       {
+        if (priv->parent && event.xconfigure.window == priv->parent) {
+          priv->parent_width = event.xconfigure.width;
+          priv->parent_height = event.xconfigure.height;
+          //let the next frame follow the parent's size
+          g_atomic_int_set (&priv->geometry_pending, TRUE);
+          break;
+        }
+
+        priv->win_width = event.xconfigure.width;
+        priv->win_height = event.xconfigure.height;
+
         if (priv->resize_cb)
           priv->resize_cb (priv->resize_data, event.xconfigure.width,
               event.xconfigure.height);
@@ -787,11 +1050,9 @@ gst_gl_window_run_loop (GstGLWindow * window)
         break;
 
       case Expose:
-        if (priv->draw_cb) {
-          priv->draw_cb (priv->draw_data);
-          eglSwapBuffers (priv->gl_display, priv->gl_surface);
-          priv->draw_finish_cb(priv->draw_data);
-        }
+        //real exposures still repaint the last frame, once the x lock
+        //is released
+        expose = TRUE;
         break;
 
       case VisibilityNotify:
@@ -833,9 +1094,12 @@ gst_gl_window_run_loop (GstGLWindow * window)
 
     }                           // switch
 
-  }                             // while running
+    g_mutex_unlock (priv->x_lock);
 
-  g_mutex_unlock (priv->x_lock);
+    if (expose)
+      gst_gl_window_redraw (priv);
+
+  }                             // while running
 
   g_debug ("end loop\n");
 }
@@ -847,80 +1111,146 @@ gst_gl_window_quit_loop (GstGLWindow * window, GstGLWindowCB callback,
 {
   if (window) {
     GstGLWindowPrivate *priv = window->priv;
+    GstGLWindowJob *job = g_slice_new0 (GstGLWindowJob);
 
-    g_mutex_lock (priv->x_lock);
+    job->callback = callback;
+    job->data = data;
+    job->quit = TRUE;
 
-    if (priv->running) {
-      XEvent event;
-
-      event.xclient.type = ClientMessage;
-      event.xclient.send_event = TRUE;
-      event.xclient.display = priv->disp_send;
-      event.xclient.window = priv->internal_win_id;
-      event.xclient.message_type =
-          XInternAtom (priv->disp_send, "WM_QUIT_LOOP", True);;
-      event.xclient.format = 32;
-#if SIZEOF_VOID_P == 8
-      event.xclient.data.l[0] = (((long) callback) >> 32) & 0xffffffff;
-      event.xclient.data.l[1] = (((long) callback)) & 0xffffffff;
-      event.xclient.data.l[2] = (((long) data) >> 32) & 0xffffffff;
-      event.xclient.data.l[3] = (((long) data)) & 0xffffffff;
-#else
-      event.xclient.data.l[0] = (long) callback;
-      event.xclient.data.l[1] = (long) data;
-#endif
+    if (!gst_gl_window_push_job (priv, job))
+      g_slice_free (GstGLWindowJob, job);
+  }
+}
 
-      XSendEvent (priv->disp_send, priv->internal_win_id, FALSE, NoEventMask,
-          &event);
-      XSync (priv->disp_send, FALSE);
-    }
+/* Not called by the gl thread, returns FALSE if the gl loop is
+ * not running and the callback was not executed */
+gboolean
+gst_gl_window_send_message (GstGLWindow * window, GstGLWindowCB callback,
+    gpointer data)
+{
+  gboolean sent = FALSE;
 
-    g_mutex_unlock (priv->x_lock);
+  if (window) {
+    GstGLWindowPrivate *priv = window->priv;
+    GstGLWindowJob job;
+
+    job.callback = callback;
+    job.data = data;
+    job.quit = FALSE;
+    job.blocking = TRUE;
+    job.done = FALSE;
+    job.fence = NULL;
+
+    if (gst_gl_window_push_job (priv, &job)) {
+      /* block until opengl calls have been executed in the gl thread */
+      g_mutex_lock (priv->send_lock);
+      while (!job.done)
+        g_cond_wait (priv->cond_send_message, priv->send_lock);
+      g_mutex_unlock (priv->send_lock);
+      sent = TRUE;
+    }
   }
+
+  return sent;
 }
 
-/* Not called by the gl thread */
+/* Not called by the gl thread, returns without waiting for the
+ * callback to be executed */
 void
-gst_gl_window_send_message (GstGLWindow * window, GstGLWindowCB callback,
+gst_gl_window_post_message (GstGLWindow * window, GstGLWindowCB callback,
     gpointer data)
 {
   if (window) {
     GstGLWindowPrivate *priv = window->priv;
+    GstGLWindowJob *job = g_slice_new0 (GstGLWindowJob);
 
-    g_mutex_lock (priv->x_lock);
+    job->callback = callback;
+    job->data = data;
 
-    if (priv->running) {
-      XEvent event;
-
-      event.xclient.type = ClientMessage;
-      event.xclient.send_event = TRUE;
-      event.xclient.display = priv->disp_send;
-      event.xclient.window = priv->internal_win_id;
-      event.xclient.message_type =
-          XInternAtom (priv->disp_send, "WM_GL_WINDOW", True);
-      event.xclient.format = 32;
-#if SIZEOF_VOID_P == 8
-      event.xclient.data.l[0] = (((long) callback) >> 32) & 0xffffffff;
-      event.xclient.data.l[1] = (((long) callback)) & 0xffffffff;
-      event.xclient.data.l[2] = (((long) data) >> 32) & 0xffffffff;
-      event.xclient.data.l[3] = (((long) data)) & 0xffffffff;
-#else
-      event.xclient.data.l[0] = (long) callback;
-      event.xclient.data.l[1] = (long) data;
-#endif
+    if (!gst_gl_window_push_job (priv, job))
+      g_slice_free (GstGLWindowJob, job);
+  }
+}
 
-      XSendEvent (priv->disp_send, priv->internal_win_id, FALSE, NoEventMask,
-          &event);
-      XSync (priv->disp_send, FALSE);
+/* Not called by the gl thread, returns a fence to wait on the
+ * execution of the callback, or NULL when the gl loop is not running.
+ * Neither this nor waiting on the fence takes the x lock */
+GstGLWindowFence *
+gst_gl_window_submit_message (GstGLWindow * window, GstGLWindowCB callback,
+    gpointer data)
+{
+  GstGLWindowFence *fence = NULL;
 
-      /* block until opengl calls have been executed in the gl thread */
-      g_cond_wait (priv->cond_send_message, priv->x_lock);
+  if (window) {
+    GstGLWindowPrivate *priv = window->priv;
+    GstGLWindowJob *job = g_slice_new0 (GstGLWindowJob);
+
+    fence = g_slice_new0 (GstGLWindowFence);
+    fence->ref_count = 2;     //one for the caller, one for the job
+    fence->done = FALSE;
+    fence->lock = g_mutex_new ();
+    fence->cond = g_cond_new ();
+
+    job->callback = callback;
+    job->data = data;
+    job->fence = fence;
+
+    if (!gst_gl_window_push_job (priv, job)) {
+      g_slice_free (GstGLWindowJob, job);
+      fence->ref_count = 1;
+      gst_gl_window_fence_unref (fence);
+      fence = NULL;
     }
+  }
 
-    g_mutex_unlock (priv->x_lock);
+  return fence;
+}
+
+GstGLWindowFence *
+gst_gl_window_fence_ref (GstGLWindowFence * fence)
+{
+  g_return_val_if_fail (fence != NULL, NULL);
+
+  g_atomic_int_inc (&fence->ref_count);
+  return fence;
+}
+
+void
+gst_gl_window_fence_unref (GstGLWindowFence * fence)
+{
+  g_return_if_fail (fence != NULL);
+
+  if (g_atomic_int_dec_and_test (&fence->ref_count)) {
+    g_mutex_free (fence->lock);
+    g_cond_free (fence->cond);
+    g_slice_free (GstGLWindowFence, fence);
   }
 }
 
+gboolean
+gst_gl_window_fence_is_done (GstGLWindowFence * fence)
+{
+  g_return_val_if_fail (fence != NULL, TRUE);
+
+  return g_atomic_int_get (&fence->done);
+}
+
+/* Not called by the gl thread, blocks until the callback of the
+ * fence has been executed */
+void
+gst_gl_window_fence_wait (GstGLWindowFence * fence)
+{
+  g_return_if_fail (fence != NULL);
+
+  if (g_atomic_int_get (&fence->done))
+    return;
+
+  g_mutex_lock (fence->lock);
+  while (!g_atomic_int_get (&fence->done))
+    g_cond_wait (fence->cond, fence->lock);
+  g_mutex_unlock (fence->lock);
+}
+
 EGLDisplay
 gst_gl_window_get_egl_display (GstGLWindow * window)
 {
@@ -932,6 +1262,25 @@ gst_gl_window_get_egl_display (GstGLWindow * window)
   return disp;
 }
 
+/* Not called by the gl thread */
+void
+gst_gl_window_add_stats (GstGLWindow * window, GstStructure * stats)
+{
+  if (window) {
+    GstGLWindowPrivate *priv = window->priv;
+
+    g_mutex_lock (priv->x_lock);
+    gst_structure_set (stats,
+        "gl-job-wakeups", G_TYPE_UINT64, priv->stat_job_wakeups,
+        "gl-jobs", G_TYPE_UINT64, priv->stat_jobs,
+        "gl-max-jobs-per-wakeup", G_TYPE_UINT, priv->stat_max_jobs,
+        "gl-draws", G_TYPE_UINT64, priv->stat_draws,
+        "gl-draws-coalesced", G_TYPE_UINT64, priv->stat_draws_coalesced,
+        NULL);
+    g_mutex_unlock (priv->x_lock);
+  }
+}
+
 const gchar *
 EGLErrorString ()
 {
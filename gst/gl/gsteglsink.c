@@ -93,6 +93,9 @@
 GST_DEBUG_CATEGORY (gst_debug_egl_sink);
 #define GST_CAT_DEFAULT gst_debug_egl_sink
 
+//a system memory buffer handed out after the texture allocation timed out
+#define GST_EGL_SINK_BUFFER_FLAG_FALLBACK GST_BUFFER_FLAG_LAST
+
 static void gst_egl_sink_init_interfaces (GType type);
 
 static void gst_egl_sink_finalize (GObject * object);
@@ -113,6 +116,9 @@ static void gst_egl_sink_get_times (GstBaseSink * bsink, GstBuffer * buf,
 static gboolean gst_egl_sink_set_caps (GstBaseSink * bsink, GstCaps * caps);
 static GstFlowReturn gst_egl_sink_show_frame (GstVideoSink *video_sink,
     GstBuffer * buf);
+static void gst_egl_sink_trim_pool (GstEGLSink * egl_sink);
+static void gst_egl_sink_update_render_delay (GstEGLSink * egl_sink);
+static void gst_egl_sink_wait_upload (GstEGLSink * egl_sink);
 
 static void gst_egl_sink_xoverlay_init (GstXOverlayClass * iface);
 static void gst_egl_sink_set_xwindow_id (GstXOverlay * overlay,
@@ -132,9 +138,64 @@ enum
   PROP_CLIENT_DRAW_CALLBACK,
   PROP_CLIENT_DATA,
   PROP_FORCE_ASPECT_RATIO,
-  PROP_PIXEL_ASPECT_RATIO
+  PROP_PIXEL_ASPECT_RATIO,
+  PROP_MIN_BUFFERS,
+  PROP_MAX_POOL_BYTES,
+  PROP_ALLOC_TIMEOUT,
+  PROP_STATS,
+  PROP_POOL_IDLE_TIMEOUT,
+  PROP_SHADER_CACHE_DIR,
+  PROP_PRESENT_MODE,
+  PROP_MAX_QUEUED_FRAMES,
+  PROP_UPLOAD_THREADS,
+  PROP_UPLOAD_COPY
 };
 
+enum
+{
+  SIGNAL_TRIM_POOL,
+  LAST_SIGNAL
+};
+
+static guint gst_egl_sink_signals[LAST_SIGNAL] = { 0 };
+
+#define GST_TYPE_EGL_SINK_PRESENT_MODE (gst_egl_sink_present_mode_get_type ())
+static GType
+gst_egl_sink_present_mode_get_type (void)
+{
+  static GType present_mode_type = 0;
+  static const GEnumValue present_modes[] = {
+    {GST_GL_DISPLAY_PRESENT_FIFO, "Wait until the pending frame is shown",
+        "fifo"},
+    {GST_GL_DISPLAY_PRESENT_MAILBOX,
+        "Replace the pending frame with the newest one, never wait", "mailbox"},
+    {0, NULL, NULL}
+  };
+
+  if (!present_mode_type)
+    present_mode_type = g_enum_register_static ("GstEGLSinkPresentMode",
+        present_modes);
+  return present_mode_type;
+}
+
+#define GST_TYPE_EGL_SINK_UPLOAD_COPY (gst_egl_sink_upload_copy_get_type ())
+static GType
+gst_egl_sink_upload_copy_get_type (void)
+{
+  static GType upload_copy_type = 0;
+  static const GEnumValue upload_copies[] = {
+    {GST_GL_DISPLAY_UPLOAD_COPY_CACHED, "Regular stores", "cached"},
+    {GST_GL_DISPLAY_UPLOAD_COPY_STREAMING,
+        "Full cache line streaming stores", "streaming"},
+    {0, NULL, NULL}
+  };
+
+  if (!upload_copy_type)
+    upload_copy_type = g_enum_register_static ("GstEGLSinkUploadCopy",
+        upload_copies);
+  return upload_copy_type;
+}
+
 /*
 static GstStaticPadTemplate gst_egl_sink_template =
     GST_STATIC_PAD_TEMPLATE ("sink",
@@ -274,6 +335,90 @@ gst_egl_sink_class_init (GstEGLSinkClass * klass)
           "The pixel aspect ratio of the device", "1/1",
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_MIN_BUFFERS,
+      g_param_spec_uint ("min-buffers", "Minimum buffers",
+          "Number of textures to preallocate when caps are set, "
+          "num-buffers-required from caps is used when larger",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_POOL_BYTES,
+      g_param_spec_uint64 ("max-pool-bytes", "Max pool bytes",
+          "Budget in bytes for the EGLImage texture pool, "
+          "0 limits the pool to a fixed number of textures instead",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOC_TIMEOUT,
+      g_param_spec_int ("alloc-timeout", "Allocation timeout",
+          "Milliseconds to wait for a texture to be released when the pool is "
+          "full before falling back to system memory, -1 waits forever",
+          -1, G_MAXINT, -1,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Texture pool counters (hits, misses, mismatched-deletions, waits, "
+          "wait-time, peak-alloc-count, bytes-allocated...), "
+          "NULL when there is no display",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_IDLE_TIMEOUT,
+      g_param_spec_uint ("pool-idle-timeout", "Pool idle timeout",
+          "Milliseconds after which an unused texture of the pool is freed, "
+          "0 keeps idle textures until the sink stops",
+          0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHADER_CACHE_DIR,
+      g_param_spec_string ("shader-cache-dir", "Shader cache directory",
+          "Directory where linked shader programs are cached across runs "
+          "(needs GL_OES_get_program_binary), NULL disables the cache. "
+          "Taken into account when the sink starts",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PRESENT_MODE,
+      g_param_spec_enum ("present-mode", "Present mode",
+          "What to do with a new frame while the previous one is not on "
+          "screen yet, mailbox drops the previous one",
+          GST_TYPE_EGL_SINK_PRESENT_MODE, GST_GL_DISPLAY_PRESENT_FIFO,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_QUEUED_FRAMES,
+      g_param_spec_int ("max-queued-frames", "Max queued frames",
+          "Number of frames that can wait to be drawn, each one after the "
+          "first adds a frame duration to the reported latency",
+          1, GST_GL_DISPLAY_MAX_QUEUED_FRAMES, 1,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_UPLOAD_THREADS,
+      g_param_spec_int ("upload-threads", "Upload threads",
+          "Number of threads converting frames that cannot be rendered "
+          "directly, each plane is split in row slices (0 = one per cpu)",
+          0, 64, 1, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_UPLOAD_COPY,
+      g_param_spec_enum ("upload-copy", "Upload copy",
+          "How frames that cannot be rendered directly are written into the "
+          "uncached image memory. The kernels used are in the stats",
+          GST_TYPE_EGL_SINK_UPLOAD_COPY, GST_GL_DISPLAY_UPLOAD_COPY_STREAMING,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstEGLSink::trim-pool:
+   * @eglsink: the #GstEGLSink
+   *
+   * Free every texture of the pool that is not held by a buffer, e.g. to
+   * give the contiguous memory back to other users.
+   */
+  gst_egl_sink_signals[SIGNAL_TRIM_POOL] =
+      g_signal_new ("trim-pool", G_TYPE_FROM_CLASS (klass),
+          G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+          G_STRUCT_OFFSET (GstEGLSinkClass, trim_pool), NULL, NULL,
+          g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+
+  klass->trim_pool = gst_egl_sink_trim_pool;
+
   gobject_class->finalize = gst_egl_sink_finalize;
 
   gstelement_class->change_state = gst_egl_sink_change_state;
@@ -304,6 +449,16 @@ gst_egl_sink_init (GstEGLSink * egl_sink,
   egl_sink->keep_aspect_ratio = FALSE;
   egl_sink->par = NULL;
   egl_sink->show_count = 0;
+  egl_sink->min_buffers = 0;
+  egl_sink->max_pool_bytes = 0;
+  egl_sink->alloc_timeout = -1;
+  egl_sink->pool_idle_timeout = 0;
+  egl_sink->shader_cache_dir = NULL;
+  egl_sink->present_mode = GST_GL_DISPLAY_PRESENT_FIFO;
+  egl_sink->max_queued_frames = 1;
+  egl_sink->upload_threads = 1;
+  egl_sink->upload_copy = GST_GL_DISPLAY_UPLOAD_COPY_STREAMING;
+  egl_sink->upload_fence = NULL;
   g_print(COLORFUL_STR("32", "%s %s build on %s %s.\n", "EGLSink", VERSION, __DATE__, __TIME__));
 }
 
@@ -360,6 +515,78 @@ gst_egl_sink_set_property (GObject * object, guint prop_id,
       }
       break;
     }
+    case PROP_MIN_BUFFERS:
+    {
+      egl_sink->min_buffers = g_value_get_uint (value);
+      break;
+    }
+    case PROP_MAX_POOL_BYTES:
+    {
+      egl_sink->max_pool_bytes = g_value_get_uint64 (value);
+      //read by the allocating threads under texlock
+      if (egl_sink->display) {
+        g_mutex_lock (egl_sink->display->texlock);
+        egl_sink->display->max_pool_bytes = egl_sink->max_pool_bytes;
+        g_mutex_unlock (egl_sink->display->texlock);
+      }
+      break;
+    }
+    case PROP_ALLOC_TIMEOUT:
+    {
+      egl_sink->alloc_timeout = g_value_get_int (value);
+      if (egl_sink->display)
+        g_atomic_int_set (&egl_sink->display->alloc_timeout,
+            egl_sink->alloc_timeout);
+      break;
+    }
+    case PROP_MAX_QUEUED_FRAMES:
+    {
+      egl_sink->max_queued_frames = g_value_get_int (value);
+      if (egl_sink->display)
+        g_atomic_int_set (&egl_sink->display->max_queued_frames,
+            egl_sink->max_queued_frames);
+      gst_egl_sink_update_render_delay (egl_sink);
+      break;
+    }
+    case PROP_UPLOAD_THREADS:
+    {
+      egl_sink->upload_threads = g_value_get_int (value);
+      if (egl_sink->display)
+        g_atomic_int_set (&egl_sink->display->upload_threads,
+            egl_sink->upload_threads);
+      break;
+    }
+    case PROP_UPLOAD_COPY:
+    {
+      egl_sink->upload_copy = g_value_get_enum (value);
+      if (egl_sink->display)
+        g_atomic_int_set (&egl_sink->display->upload_copy,
+            egl_sink->upload_copy);
+      break;
+    }
+    case PROP_PRESENT_MODE:
+    {
+      egl_sink->present_mode = g_value_get_enum (value);
+      if (egl_sink->display)
+        g_atomic_int_set (&egl_sink->display->present_mode,
+            egl_sink->present_mode);
+      gst_egl_sink_update_render_delay (egl_sink);
+      break;
+    }
+    case PROP_SHADER_CACHE_DIR:
+    {
+      g_free (egl_sink->shader_cache_dir);
+      egl_sink->shader_cache_dir = g_value_dup_string (value);
+      break;
+    }
+    case PROP_POOL_IDLE_TIMEOUT:
+    {
+      egl_sink->pool_idle_timeout = g_value_get_uint (value);
+      if (egl_sink->display)
+        gst_gl_display_set_idle_timeout (egl_sink->display,
+            egl_sink->pool_idle_timeout * GST_MSECOND);
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -384,6 +611,7 @@ gst_egl_sink_finalize (GObject * object)
     gst_caps_unref (egl_sink->caps);
 
   g_free (egl_sink->display_name);
+  g_free (egl_sink->shader_cache_dir);
 
   GST_DEBUG ("finalized");
 }
@@ -411,6 +639,39 @@ gst_egl_sink_get_property (GObject * object, guint prop_id,
       else
         g_value_set_static_string(value, "1/1");
       break;
+    case PROP_MIN_BUFFERS:
+      g_value_set_uint (value, egl_sink->min_buffers);
+      break;
+    case PROP_MAX_POOL_BYTES:
+      g_value_set_uint64 (value, egl_sink->max_pool_bytes);
+      break;
+    case PROP_ALLOC_TIMEOUT:
+      g_value_set_int (value, egl_sink->alloc_timeout);
+      break;
+    case PROP_STATS:
+      if (egl_sink->display)
+        g_value_take_boxed (value, gst_gl_display_get_stats (egl_sink->display));
+      else
+        g_value_set_boxed (value, NULL);
+      break;
+    case PROP_POOL_IDLE_TIMEOUT:
+      g_value_set_uint (value, egl_sink->pool_idle_timeout);
+      break;
+    case PROP_SHADER_CACHE_DIR:
+      g_value_set_string (value, egl_sink->shader_cache_dir);
+      break;
+    case PROP_PRESENT_MODE:
+      g_value_set_enum (value, egl_sink->present_mode);
+      break;
+    case PROP_MAX_QUEUED_FRAMES:
+      g_value_set_int (value, egl_sink->max_queued_frames);
+      break;
+    case PROP_UPLOAD_THREADS:
+      g_value_set_int (value, egl_sink->upload_threads);
+      break;
+    case PROP_UPLOAD_COPY:
+      g_value_set_enum (value, egl_sink->upload_copy);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -462,7 +723,24 @@ gst_egl_sink_change_state (GstElement * element, GstStateChange transition)
       if (!egl_sink->display && !egl_sink->draw_callback) {
         GST_INFO("Create GLDisplay");
         egl_sink->display = gst_gl_display_new ();
-        egl_sink->display->keep_aspect_ratio = egl_sink->keep_aspect_ratio;
+        //no other thread sees the display before create_context
+        g_atomic_int_set (&egl_sink->display->keep_aspect_ratio,
+            egl_sink->keep_aspect_ratio);
+        egl_sink->display->max_pool_bytes = egl_sink->max_pool_bytes;
+        g_atomic_int_set (&egl_sink->display->alloc_timeout,
+            egl_sink->alloc_timeout);
+        egl_sink->display->idle_timeout =
+            egl_sink->pool_idle_timeout * GST_MSECOND;
+        egl_sink->display->shader_cache_dir =
+            g_strdup (egl_sink->shader_cache_dir);
+        g_atomic_int_set (&egl_sink->display->present_mode,
+            egl_sink->present_mode);
+        g_atomic_int_set (&egl_sink->display->max_queued_frames,
+            egl_sink->max_queued_frames);
+        g_atomic_int_set (&egl_sink->display->upload_threads,
+            egl_sink->upload_threads);
+        g_atomic_int_set (&egl_sink->display->upload_copy,
+            egl_sink->upload_copy);
         /* init opengl context */
         gst_gl_display_create_context (egl_sink->display, 0);
       }
@@ -482,6 +760,8 @@ gst_egl_sink_change_state (GstElement * element, GstStateChange transition)
       break;
     case GST_STATE_CHANGE_PAUSED_TO_READY:
     {
+      gst_egl_sink_wait_upload (egl_sink);
+
       if (egl_sink->display) {
         gst_gl_display_destroy_context(egl_sink->display);
         g_object_unref (egl_sink->display);
@@ -517,7 +797,20 @@ gst_egl_sink_buffer_alloc (GstBaseSink * sink,
   if(egl_sink->get_buffer_callback)
     buffer = egl_sink->get_buffer_callback (caps, size, egl_sink->client_data);
   else if(egl_sink->display)
-    buffer = GST_BUFFER_CAST(gst_gl_display_get_free_buffer(egl_sink->display, caps, size, TRUE));
+  {
+    GstGLDisplayAllocResult result;
+    buffer = GST_BUFFER_CAST(gst_gl_display_get_free_buffer(egl_sink->display,
+        caps, size, TRUE, TRUE, &result));
+    if(!buffer && result == GST_GL_DISPLAY_ALLOC_TIMEOUT)
+    {
+      //the pool stayed full, let the frame go through the upload path
+      GST_WARNING_OBJECT (egl_sink, "texture allocation timed out after %d ms, "
+          "falling back to a system memory buffer", egl_sink->alloc_timeout);
+      buffer = gst_buffer_new_and_alloc (size);
+      gst_buffer_set_caps (buffer, caps);
+      GST_BUFFER_FLAG_SET (buffer, GST_EGL_SINK_BUFFER_FLAG_FALLBACK);
+    }
+  }
   if(buffer)
     GST_BUFFER_OFFSET(buffer) = offset;
   *buf = buffer;
@@ -570,16 +863,26 @@ gst_egl_sink_set_caps (GstBaseSink * bsink, GstCaps * caps)
     return egl_sink->set_caps_callback(caps, egl_sink->client_data);
   
   s = gst_caps_get_structure (caps, 0);
-  if(gst_structure_get_int (s, "num-buffers-required", &bufcount) &&
-      bufcount > GST_GL_DISPLAY_MAX_BUFFER_COUNT) {
-    GST_WARNING("num-buffers-required %d exceed max eglsink buffer count %d", bufcount, GST_GL_DISPLAY_MAX_BUFFER_COUNT);
-    return FALSE;
-  }
+  if(!gst_structure_get_int (s, "num-buffers-required", &bufcount))
+    bufcount = 0;
   
   ok = gst_video_format_parse_caps (caps, &format, &width, &height);
   if (!ok)
     return FALSE;
 
+  if(egl_sink->max_pool_bytes) {
+    guint64 needed = (guint64) bufcount *
+        gst_egl_platform_get_image_size (format, width, height);
+    if(needed > egl_sink->max_pool_bytes) {
+      GST_WARNING("num-buffers-required %d need %" G_GUINT64_FORMAT " bytes, exceed "
+          "max-pool-bytes %" G_GUINT64_FORMAT, bufcount, needed, egl_sink->max_pool_bytes);
+      return FALSE;
+    }
+  } else if(bufcount > GST_GL_DISPLAY_MAX_BUFFER_COUNT) {
+    GST_WARNING("num-buffers-required %d exceed max eglsink buffer count %d", bufcount, GST_GL_DISPLAY_MAX_BUFFER_COUNT);
+    return FALSE;
+  }
+
   ok &= gst_video_parse_caps_framerate (caps, &fps_n, &fps_d);
   ok &= gst_video_parse_caps_pixel_aspect_ratio (caps, &par_n, &par_d);
 
@@ -629,10 +932,16 @@ gst_egl_sink_set_caps (GstBaseSink * bsink, GstCaps * caps)
   egl_sink->fps_d = fps_d;
   egl_sink->par_n = par_n;
   egl_sink->par_d = par_d;
+  gst_egl_sink_update_render_delay (egl_sink);
 
   if (!egl_sink->window_id && !egl_sink->new_window_id)
     gst_x_overlay_prepare_xwindow_id (GST_X_OVERLAY (egl_sink));
 
+  //warm up the texture pool so the first frames don't pay for image creation
+  if (egl_sink->display)
+    gst_gl_display_prealloc_textures (egl_sink->display, caps,
+        MAX (bufcount, (gint) egl_sink->min_buffers));
+
   return TRUE;
 }
 
@@ -659,10 +968,24 @@ gst_egl_sink_show_frame (GstVideoSink *video_sink, GstBuffer *buf)
   }
   //is not egl
   else {
+    GstGLDisplayAllocResult result;
+    //a fallback buffer already waited alloc-timeout in buffer_alloc, only
+    //take a texture that is free by now
+    gboolean wait = !GST_BUFFER_FLAG_IS_SET (buf,
+        GST_EGL_SINK_BUFFER_FLAG_FALLBACK);
     egl_buffer = gst_gl_display_get_free_buffer (egl_sink->display,
-        GST_BUFFER_CAPS(buf), -1, FALSE);
-    if(egl_buffer)
-      gst_gl_display_do_upload (egl_sink->display, egl_buffer, buf);
+        GST_BUFFER_CAPS(buf), -1, FALSE, wait, &result);
+    if(egl_buffer) {
+      //keep a single upload in flight, the gl thread converts this
+      //frame while upstream produces the next one
+      gst_egl_sink_wait_upload (egl_sink);
+      egl_sink->upload_fence = gst_gl_display_do_upload_async (
+          egl_sink->display, egl_buffer, buf);
+    }
+    else if(result == GST_GL_DISPLAY_ALLOC_TIMEOUT) {
+      GST_WARNING_OBJECT (egl_sink, "no texture to upload into, dropping frame");
+      return GST_FLOW_OK;
+    }
     else
       return GST_FLOW_UNEXPECTED;
   }
@@ -688,6 +1011,42 @@ gst_egl_sink_show_frame (GstVideoSink *video_sink, GstBuffer *buf)
 }
 
 
+/* In fifo mode frames queued behind the next one to draw are shown that
+ * many frame durations later, basesink adds the render delay to its latency.
+ * Mailbox mode drops the queued frames instead, so it adds no delay */
+static void
+gst_egl_sink_update_render_delay (GstEGLSink * egl_sink)
+{
+  GstClockTime delay = 0;
+
+  if (egl_sink->fps_n > 0 &&
+      egl_sink->present_mode == GST_GL_DISPLAY_PRESENT_FIFO)
+    delay = gst_util_uint64_scale_int (GST_SECOND,
+        egl_sink->fps_d * (egl_sink->max_queued_frames - 1), egl_sink->fps_n);
+
+  GST_DEBUG_OBJECT (egl_sink, "render delay %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (delay));
+  gst_base_sink_set_render_delay (GST_BASE_SINK (egl_sink), delay);
+}
+
+static void
+gst_egl_sink_wait_upload (GstEGLSink * egl_sink)
+{
+  if (egl_sink->upload_fence) {
+    gst_gl_window_fence_wait (egl_sink->upload_fence);
+    gst_gl_window_fence_unref (egl_sink->upload_fence);
+    egl_sink->upload_fence = NULL;
+  }
+}
+
+static void
+gst_egl_sink_trim_pool (GstEGLSink * egl_sink)
+{
+  GST_INFO_OBJECT (egl_sink, "trim texture pool");
+  if (egl_sink->display)
+    gst_gl_display_trim_pool (egl_sink->display);
+}
+
 static void
 gst_egl_sink_xoverlay_init (GstXOverlayClass * iface)
 {
@@ -75,11 +75,24 @@ struct _GstEGLSink
     GValue *par;
 
     gint show_count;
+    guint min_buffers;
+    guint64 max_pool_bytes;
+    gint alloc_timeout;
+    guint pool_idle_timeout;
+    gchar *shader_cache_dir;
+    gint present_mode;  //GstGLDisplayPresentMode
+    gint max_queued_frames;
+    gint upload_threads;
+    gint upload_copy;  //GstGLDisplayUploadCopy
+    gpointer upload_fence;  //GstGLWindowFence of the last software upload
 };
 
 struct _GstEGLSinkClass
 {
     GstVideoSinkClass video_sink_class;
+
+    //actions
+    void (*trim_pool) (GstEGLSink * egl_sink);
 };
 
 GType gst_egl_sink_get_type(void);
@@ -0,0 +1,260 @@
+/*
+ * GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Times the cached (memcpy) and streaming store kernels on the copies a
+ * software upload makes, for each format and frame size.
+ *
+ * The destination follows the image layout of the fsl platform: rgb32 rows
+ * padded to 32 pixels, yv12 planes with 64 byte luma and 32 byte chroma
+ * strides, each plane starting on a page. Frames are cycled through a set
+ * of sources and destinations larger than the caches, and a warm up pass
+ * touches every page first, so that the steady state is measured rather
+ * than page faults or cache hits.
+ *
+ *   eglconvert-copy [iterations [threads]]
+ *
+ * The memory is malloc'd, on the target the image memory may be mapped
+ * uncached or write-combined, which favors the streaming kernels further.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/gl/gsteglconvert.h>
+
+#define FRAMES 8
+#define ROUND_UP(n, a) (((n) + (a) - 1) & ~((a) - 1))
+
+typedef enum
+{
+  COPY_YV12,                    //i420 to yv12, three planes copied
+  COPY_RGBA,                    //rgba to rgba
+  FILL_RGBA                     //rgbx to rgba, alpha set
+} CopyKind;
+
+typedef struct
+{
+  const gchar *name;
+  CopyKind kind;
+} Format;
+
+static const Format formats[] = {
+  {"I420", COPY_YV12},
+  {"RGBA", COPY_RGBA},
+  {"RGBx", FILL_RGBA},
+};
+
+static const gint sizes[][2] = {
+  {320, 240},
+  {640, 480},
+  {1280, 720},
+  {1920, 1080},
+};
+
+typedef struct
+{
+  gsize src_size;
+  gsize dst_size;
+  guint8 *src[FRAMES];
+  guint8 *dst[FRAMES];
+  GstEGLConvertOp ops[FRAMES][3];
+  gint n_ops;
+  gsize bytes;                  //written per frame
+} Frames;
+
+static void
+set_op (GstEGLConvertOp * op, GstEGLCopyRowsFunc func, guint8 * dst,
+    gint dst_stride, const guint8 * src, gint src_stride, gint row_bytes,
+    gint rows, gint unit)
+{
+  op->func = func;
+  op->dst = dst;
+  op->dst_stride = dst_stride;
+  op->src = src;
+  op->src_stride = src_stride;
+  op->row_bytes = row_bytes;
+  op->rows = rows;
+  op->unit = unit;
+}
+
+static void
+frames_init (Frames * frames, CopyKind kind, gint width, gint height)
+{
+  gint i, y_stride, uv_stride, uv_src_stride;
+  gsize y_size, uv_size, uv_src_size;
+
+  memset (frames, 0, sizeof (Frames));
+
+  switch (kind) {
+    case COPY_YV12:
+      y_stride = ROUND_UP (width, 64);
+      uv_stride = ROUND_UP (y_stride / 2, 32);
+      uv_src_stride = ROUND_UP (width, 8) / 2;
+      y_size = ROUND_UP ((gsize) y_stride * ROUND_UP (height, 32), 4096);
+      uv_size = ROUND_UP ((gsize) uv_stride * ROUND_UP (height / 2, 32), 4096);
+      uv_src_size = (gsize) uv_src_stride * height / 2;
+      frames->src_size = (gsize) ROUND_UP (width, 4) * height + 2 * uv_src_size;
+      frames->dst_size = y_size + 2 * uv_size;
+      frames->bytes = (gsize) width * height * 3 / 2;
+      frames->n_ops = 3;
+      break;
+    default:
+      y_stride = ROUND_UP (width, 32) * 4;
+      frames->src_size = (gsize) width * 4 * height;
+      frames->dst_size = (gsize) y_stride * height;
+      frames->bytes = (gsize) width * 4 * height;
+      frames->n_ops = 1;
+      break;
+  }
+
+  for (i = 0; i < FRAMES; i++) {
+    guint8 *src = frames->src[i] = g_malloc (frames->src_size);
+    guint8 *dst = frames->dst[i] = g_malloc (frames->dst_size + 4096);
+
+    //images are page aligned
+    dst = (guint8 *) ROUND_UP ((gsize) dst, 4096);
+    memset (src, i + 1, frames->src_size);
+
+    if (kind == COPY_YV12) {
+      const guint8 *src_u = src + (gsize) ROUND_UP (width, 4) * height;
+
+      set_op (&frames->ops[i][0], NULL, dst, y_stride, src,
+          ROUND_UP (width, 4), width, height, 1);
+      set_op (&frames->ops[i][1], NULL, dst + y_size + uv_size, uv_stride,
+          src_u, uv_src_stride, width / 2, height / 2, 1);
+      set_op (&frames->ops[i][2], NULL, dst + y_size, uv_stride,
+          src_u + uv_src_size, uv_src_stride, width / 2, height / 2, 1);
+    } else {
+      set_op (&frames->ops[i][0], NULL, dst, y_stride, src, width * 4,
+          kind == FILL_RGBA ? width : width * 4, height,
+          kind == FILL_RGBA ? 4 : 1);
+    }
+  }
+}
+
+static void
+frames_clear (Frames * frames)
+{
+  gint i;
+
+  for (i = 0; i < FRAMES; i++) {
+    g_free (frames->src[i]);
+    g_free (frames->dst[i]);
+  }
+}
+
+static gint
+compare_times (gconstpointer a, gconstpointer b)
+{
+  GstClockTime ta = *(const GstClockTime *) a;
+  GstClockTime tb = *(const GstClockTime *) b;
+
+  return ta < tb ? -1 : ta > tb;
+}
+
+/* Median time per frame */
+static GstClockTime
+run (Frames * frames, CopyKind kind, const GstEGLConvertKernels * kernels,
+    GstEGLConvertPool * pool, gint iterations, GstClockTime * times)
+{
+  GstEGLCopyRowsFunc func = kind == FILL_RGBA ?
+      kernels->fill_alpha_rows : kernels->copy_rows;
+  gint i, j;
+
+  for (i = 0; i < FRAMES; i++)
+    for (j = 0; j < frames->n_ops; j++)
+      frames->ops[i][j].func = func;
+
+  //every page is touched before timing
+  for (i = 0; i < FRAMES; i++)
+    gst_egl_convert_run (pool, frames->ops[i], frames->n_ops);
+
+  for (i = 0; i < iterations; i++) {
+    GstClockTime start = gst_util_get_timestamp ();
+    gst_egl_convert_run (pool, frames->ops[i % FRAMES], frames->n_ops);
+    times[i] = gst_util_get_timestamp () - start;
+  }
+
+  qsort (times, iterations, sizeof (GstClockTime), compare_times);
+  return times[iterations / 2];
+}
+
+gint
+main (gint argc, gchar ** argv)
+{
+  const GstEGLConvertKernels *cached, *streaming;
+  GstEGLConvertPool *pool = NULL;
+  GstClockTime *times;
+  gint iterations = 200, threads = 1, f, s;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1)
+    iterations = MAX (1, atoi (argv[1]));
+  if (argc > 2)
+    threads = atoi (argv[2]);
+
+  cached = gst_egl_convert_get_kernels ();
+  streaming = gst_egl_convert_get_streaming_kernels ();
+  if (!streaming) {
+    g_printerr ("no streaming kernels on this cpu\n");
+    return 1;
+  }
+  if (threads != 1)
+    pool = gst_egl_convert_pool_new (threads);
+
+  times = g_new (GstClockTime, iterations);
+
+  g_print ("%-6s %-10s %12s %12s %8s %10s %10s\n", "format", "size",
+      cached->name, streaming->name, "ratio", "MB/s", "MB/s");
+
+  for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+    for (s = 0; s < G_N_ELEMENTS (sizes); s++) {
+      Frames frames;
+      GstClockTime t_cached, t_streaming;
+      gchar size[16];
+
+      frames_init (&frames, formats[f].kind, sizes[s][0], sizes[s][1]);
+      t_cached = run (&frames, formats[f].kind, cached, pool, iterations,
+          times);
+      t_streaming = run (&frames, formats[f].kind, streaming, pool,
+          iterations, times);
+
+      g_snprintf (size, sizeof (size), "%dx%d", sizes[s][0], sizes[s][1]);
+      g_print ("%-6s %-10s %10.1fus %10.1fus %8.2f %10.0f %10.0f\n",
+          formats[f].name, size, t_cached / 1000.0, t_streaming / 1000.0,
+          (gdouble) t_streaming / t_cached,
+          frames.bytes * 1000.0 / t_cached,
+          frames.bytes * 1000.0 / t_streaming);
+
+      frames_clear (&frames);
+    }
+  }
+
+  g_free (times);
+  if (pool)
+    gst_egl_convert_pool_free (pool);
+
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Times blocking calls into the gl thread.
+ *
+ * "send_message" is gst_gl_window_send_message with an empty callback, the
+ * job queue and wake up pipe path. "x round trip" is what every call paid
+ * before that on the sender side alone: an XSendEvent of a ClientMessage
+ * and an XSync on a second connection, without the gl thread picking the
+ * event back up. Needs a running X server and EGL.
+ *
+ *   glwindow-roundtrip [calls]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+
+#include <gst/gst.h>
+#include <gst/gl/gstgldisplay.h>
+
+static void
+noop (gpointer data)
+{
+  (*(gint *) data)++;
+}
+
+static gdouble
+elapsed_us (GTimeVal * start, gint calls)
+{
+  GTimeVal end;
+
+  g_get_current_time (&end);
+  return ((end.tv_sec - start->tv_sec) * G_USEC_PER_SEC +
+      (end.tv_usec - start->tv_usec)) / (gdouble) calls;
+}
+
+gint
+main (gint argc, gchar ** argv)
+{
+  GstGLDisplay *display;
+  Display *disp;
+  XEvent event;
+  GTimeVal start;
+  gint calls = 10000, done = 0, i;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1)
+    calls = MAX (1, atoi (argv[1]));
+
+  disp = XOpenDisplay (NULL);
+  if (!disp) {
+    g_printerr ("cannot open the X display\n");
+    return 1;
+  }
+
+  display = gst_gl_display_new ();
+  gst_gl_display_create_context (display, 0);
+  if (!display->gl_window || !display->isAlive) {
+    g_printerr ("cannot create the gl context\n");
+    return 1;
+  }
+
+  //warm up both paths
+  for (i = 0; i < 100; i++) {
+    gst_gl_window_send_message (display->gl_window, noop, &done);
+    XSync (disp, FALSE);
+  }
+
+  g_get_current_time (&start);
+  for (i = 0; i < calls; i++)
+    gst_gl_window_send_message (display->gl_window, noop, &done);
+  g_print ("send_message: %d calls, %.2f us per call\n", calls,
+      elapsed_us (&start, calls));
+
+  memset (&event, 0, sizeof (event));
+  event.xclient.type = ClientMessage;
+  event.xclient.send_event = TRUE;
+  event.xclient.display = disp;
+  event.xclient.window = DefaultRootWindow (disp);
+  event.xclient.message_type = XInternAtom (disp, "WM_GL_WINDOW", False);
+  event.xclient.format = 32;
+
+  g_get_current_time (&start);
+  for (i = 0; i < calls; i++) {
+    XSendEvent (disp, DefaultRootWindow (disp), FALSE, NoEventMask, &event);
+    XSync (disp, FALSE);
+  }
+  g_print ("x round trip: %d calls, %.2f us per call\n", calls,
+      elapsed_us (&start, calls));
+
+  g_object_unref (display);
+  XCloseDisplay (disp);
+
+  return 0;
+}
@@ -0,0 +1,272 @@
+/* GStreamer
+ *
+ * unit tests for the software upload copy kernels
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/check/gstcheck.h>
+#include <gst/gl/gsteglconvert.h>
+
+/* bytes around the rows that no kernel may write */
+#define GUARD 64
+#define ROWS 3
+
+static void
+fill_pattern (guint8 * data, gsize size, guint32 seed)
+{
+  gsize i;
+
+  for (i = 0; i < size; i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = seed >> 16;
+  }
+}
+
+/* Runs the kernels and the reference on the same source into two
+ * destinations prefilled alike, the whole destinations must match: the
+ * rows, the stride padding between them and the guards around them */
+static gboolean
+check_rows (const GstEGLConvertKernels * kernels, gboolean fill_alpha,
+    gint units, gint src_offset, gint src_pad, gint dst_offset, gint dst_pad)
+{
+  const GstEGLConvertKernels *ref = gst_egl_convert_get_reference_kernels ();
+  gint bytes = fill_alpha ? units * 4 : units;
+  gint src_stride = bytes + src_pad;
+  gint dst_stride = bytes + dst_pad;
+  gsize src_size = GUARD + src_offset + (gsize) src_stride * ROWS;
+  gsize dst_size = GUARD + dst_offset + (gsize) dst_stride * ROWS + GUARD;
+  guint8 *src = g_malloc (src_size);
+  guint8 *expected = g_malloc (dst_size);
+  guint8 *result = g_malloc (dst_size);
+  gboolean ok;
+
+  fill_pattern (src, src_size, units);
+  fill_pattern (expected, dst_size, ~units);
+  memcpy (result, expected, dst_size);
+
+  if (fill_alpha) {
+    ref->fill_alpha_rows (expected + GUARD + dst_offset, dst_stride,
+        src + GUARD + src_offset, src_stride, units, ROWS);
+    kernels->fill_alpha_rows (result + GUARD + dst_offset, dst_stride,
+        src + GUARD + src_offset, src_stride, units, ROWS);
+  } else {
+    ref->copy_rows (expected + GUARD + dst_offset, dst_stride,
+        src + GUARD + src_offset, src_stride, units, ROWS);
+    kernels->copy_rows (result + GUARD + dst_offset, dst_stride,
+        src + GUARD + src_offset, src_stride, units, ROWS);
+  }
+  ok = memcmp (expected, result, dst_size) == 0;
+
+  g_free (src);
+  g_free (expected);
+  g_free (result);
+
+  return ok;
+}
+
+/* Odd row lengths around and well past the vector and cache line sizes */
+static const gint row_bytes[] = {
+  1, 2, 3, 7, 15, 16, 17, 31, 33, 47, 63, 64, 65, 79, 95, 127, 128, 129,
+  191, 255, 257, 511, 1023, 1921
+};
+
+static const gint pixels[] = {
+  1, 2, 3, 5, 7, 9, 15, 16, 17, 31, 33, 63, 65, 127, 129, 479, 481
+};
+
+static void
+check_all (gboolean fill_alpha)
+{
+  const GstEGLConvertKernels *const *k;
+  const gint *units = fill_alpha ? pixels : row_bytes;
+  gint n_units = fill_alpha ? G_N_ELEMENTS (pixels) : G_N_ELEMENTS (row_bytes);
+  gint u, so, dof, pad;
+
+  for (k = gst_egl_convert_get_available_kernels (); *k; k++) {
+    GST_INFO ("checking %s %s kernels", fill_alpha ? "fill_alpha_rows" :
+        "copy_rows", (*k)->name);
+    for (u = 0; u < n_units; u++)
+      //every misalignment of the source and destination, with packed
+      //rows and with odd and line sized stride padding
+      for (so = 0; so < 16; so++)
+        for (dof = 0; dof < 16; dof++)
+          for (pad = 0; pad < 3; pad++)
+            fail_unless (check_rows (*k, fill_alpha, units[u], so,
+                    pad == 1 ? 5 : pad * 32, dof, pad == 1 ? 3 : pad * 64),
+                "%s kernels: %d %s, src offset %d, dst offset %d, pad %d",
+                (*k)->name, units[u], fill_alpha ? "pixels" : "bytes", so,
+                dof, pad);
+  }
+}
+
+GST_START_TEST (test_copy_rows)
+{
+  check_all (FALSE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_fill_alpha_rows)
+{
+  check_all (TRUE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_fill_alpha_value)
+{
+  const GstEGLConvertKernels *const *k;
+  guint8 src[17 * 4], dst[17 * 4];
+  gint i;
+
+  fill_pattern (src, sizeof (src), 1);
+
+  for (k = gst_egl_convert_get_available_kernels (); *k; k++) {
+    memset (dst, 0, sizeof (dst));
+    (*k)->fill_alpha_rows (dst, sizeof (dst), src, sizeof (src), 17, 1);
+    for (i = 0; i < 17 * 4; i++)
+      fail_unless_equals_int (dst[i], (i & 3) == 3 ? 0xff : src[i]);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_empty_rows)
+{
+  const GstEGLConvertKernels *const *k;
+  guint8 src[64], dst[64], orig[64];
+
+  fill_pattern (src, sizeof (src), 2);
+  fill_pattern (orig, sizeof (orig), 3);
+
+  for (k = gst_egl_convert_get_available_kernels (); *k; k++) {
+    memcpy (dst, orig, sizeof (dst));
+    (*k)->copy_rows (dst, 16, src, 16, 0, 4);
+    (*k)->copy_rows (dst, 16, src, 16, 16, 0);
+    (*k)->fill_alpha_rows (dst, 16, src, 16, 0, 4);
+    (*k)->fill_alpha_rows (dst, 16, src, 16, 4, 0);
+    fail_unless (memcmp (dst, orig, sizeof (dst)) == 0, "%s kernels",
+        (*k)->name);
+  }
+}
+
+GST_END_TEST;
+
+/* The pool cuts ops in row slices, and copies planes with matching
+ * strides as one block, the result must not depend on either */
+GST_START_TEST (test_convert_run)
+{
+  const GstEGLConvertKernels *ref = gst_egl_convert_get_reference_kernels ();
+  const GstEGLConvertKernels *const *k;
+  gint widths[] = { 1, 63, 641 };
+  gint threads[] = { 1, 2, 3, 7 };
+  gint rows = 97;
+  gint w, t;
+
+  for (k = gst_egl_convert_get_available_kernels (); *k; k++) {
+    for (w = 0; w < G_N_ELEMENTS (widths); w++) {
+      gint width = widths[w];
+      gint packed = width * 4, padded = width * 4 + 36;
+      gsize size = (gsize) padded * rows + 3;
+      guint8 *src = g_malloc (size);
+      guint8 *orig = g_malloc (3 * size);
+      guint8 *expected = g_malloc (3 * size);
+      guint8 *result = g_malloc (3 * size);
+
+      fill_pattern (src, size, width);
+      fill_pattern (orig, 3 * size, ~width);
+
+      memcpy (expected, orig, 3 * size);
+      ref->copy_rows (expected + 1, packed, src + 3, packed, packed, rows);
+      ref->copy_rows (expected + size + 2, padded, src, packed,
+          packed - 1, rows);
+      ref->fill_alpha_rows (expected + 2 * size, padded, src, padded,
+          width, rows);
+
+      for (t = 0; t < G_N_ELEMENTS (threads); t++) {
+        GstEGLConvertPool *pool = gst_egl_convert_pool_new (threads[t]);
+        GstEGLConvertOp ops[3];
+
+        memcpy (result, orig, 3 * size);
+
+        //matching strides, from an odd address
+        ops[0].func = (*k)->copy_rows;
+        ops[0].dst = result + 1;
+        ops[0].dst_stride = packed;
+        ops[0].src = src + 3;
+        ops[0].src_stride = packed;
+        ops[0].row_bytes = packed;
+        ops[0].rows = rows;
+        ops[0].unit = 1;
+
+        //a padded destination
+        ops[1] = ops[0];
+        ops[1].dst = result + size + 2;
+        ops[1].dst_stride = padded;
+        ops[1].src = src;
+        ops[1].row_bytes = packed - 1;
+
+        //alpha filled pixels
+        ops[2] = ops[1];
+        ops[2].func = (*k)->fill_alpha_rows;
+        ops[2].dst = result + 2 * size;
+        ops[2].src_stride = padded;
+        ops[2].row_bytes = width;
+        ops[2].unit = 4;
+
+        gst_egl_convert_run (pool, ops, 3);
+
+        fail_unless (memcmp (expected, result, 3 * size) == 0,
+            "%s kernels, width %d, %d threads", (*k)->name, width,
+            threads[t]);
+
+        gst_egl_convert_pool_free (pool);
+      }
+
+      g_free (src);
+      g_free (orig);
+      g_free (expected);
+      g_free (result);
+    }
+  }
+}
+
+GST_END_TEST;
+
+static Suite *
+eglconvert_suite (void)
+{
+  Suite *s = suite_create ("eglconvert");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_copy_rows);
+  tcase_add_test (tc_chain, test_fill_alpha_rows);
+  tcase_add_test (tc_chain, test_fill_alpha_value);
+  tcase_add_test (tc_chain, test_empty_rows);
+  tcase_add_test (tc_chain, test_convert_run);
+
+  return s;
+}
+
+GST_CHECK_MAIN (eglconvert);